@@ -0,0 +1,57 @@
+// Reusable per-round storage for measurement bundles.
+
+#ifndef __MEASUREMENT_ROUND_H__
+#define __MEASUREMENT_ROUND_H__
+
+#include "abet.h"
+#include <list>
+#include <vector>
+
+// Non-owning view over contiguous bundles (no std::span in C++17)
+class MeasurementSpan{
+public:
+    MeasurementSpan(): m_data(nullptr), m_size(0) {};
+    MeasurementSpan(const MeasurementBundle* data, size_t size): m_data(data), m_size(size) {};
+    const MeasurementBundle* begin() const { return m_data; };
+    const MeasurementBundle* end() const { return m_data + m_size; };
+    const MeasurementBundle& operator[](size_t i) const { return m_data[i]; };
+    size_t size() const { return m_size; };
+    bool empty() const { return m_size == 0; };
+private:
+    const MeasurementBundle* m_data;
+    size_t m_size;
+};
+
+
+/* Bundles of one measurement round. clear() keeps slots alive, so appending
+ * copy-assigns into old bundles and reuses their delay vectors: after the first
+ * rounds no heap allocation happens here.
+ */
+class MeasurementRound{
+public:
+    MeasurementRound(): m_size(0) {};
+
+    void append(const MeasurementBundle& mb){
+        if (m_size == m_bundles.size()){
+            m_bundles.push_back(mb);
+        } else {
+            m_bundles[m_size] = mb;
+        }
+        m_size += 1;
+    }
+
+    void append(const std::list<MeasurementBundle>& mb_list){
+        for (const auto& mb: mb_list){
+            append(mb);
+        }
+    }
+
+    void clear(){ m_size = 0; };
+    size_t size() const { return m_size; };
+    MeasurementSpan span() const { return MeasurementSpan(m_bundles.data(), m_size); };
+private:
+    std::vector<MeasurementBundle> m_bundles;   // slots after m_size are kept for reuse
+    size_t m_size;
+};
+
+#endif
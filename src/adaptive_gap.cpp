@@ -0,0 +1,58 @@
+#include "adaptive_gap.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+AdaptiveGap::AdaptiveGap(int min_gap, int max_gap, double change_threshold, double loss_threshold):
+m_min_gap(min_gap), m_max_gap(std::max(min_gap, max_gap)), m_gap(min_gap),
+m_change_threshold(change_threshold), m_loss_threshold(loss_threshold), m_has_baseline(false),
+m_abw(0), m_rtt(0), m_loss(0)
+{
+    if (min_gap <= 0){
+        throw std::runtime_error("Minimum measurement gap must be positive");
+    }
+}
+
+
+int AdaptiveGap::get_gap() const{
+    return m_gap;
+}
+
+int AdaptiveGap::get_min_gap() const{
+    return m_min_gap;
+}
+
+int AdaptiveGap::get_max_gap() const{
+    return m_max_gap;
+}
+
+
+bool AdaptiveGap::is_shifted(double value, double baseline, double threshold, double min_shift){
+    return std::fabs(value - baseline) > std::max(threshold * std::fabs(baseline), min_shift);
+}
+
+
+int AdaptiveGap::update(float abw, int rtt, double loss){
+    if (!m_has_baseline){
+        m_abw = abw;
+        m_rtt = rtt;
+        m_loss = loss;
+        m_has_baseline = true;
+        return m_gap;
+    }
+
+    bool changed = is_shifted(abw, m_abw, m_change_threshold) ||
+                   is_shifted(rtt, m_rtt, m_change_threshold, GAP_MIN_RTT_SHIFT) ||
+                   std::fabs(loss - m_loss) > m_loss_threshold;
+    if (changed){
+        m_gap = m_min_gap;
+    } else {
+        // grows by at least 1 us, so small gaps don't get stuck
+        m_gap = (int)std::min(std::max(m_gap * GAP_GROWTH, m_gap + 1.0), (double)m_max_gap);
+    }
+
+    m_abw += GAP_BASELINE_ALPHA * (abw - m_abw);
+    m_rtt += GAP_BASELINE_ALPHA * (rtt - m_rtt);
+    m_loss += GAP_BASELINE_ALPHA * (loss - m_loss);
+    return m_gap;
+}
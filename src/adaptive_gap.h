@@ -0,0 +1,43 @@
+#ifndef __AdaptiveGap__
+#define __AdaptiveGap__
+
+// relative change of abw or rtt against baseline
+#define DEFAULT_GAP_CHANGE_THRESHOLD 0.2
+// absolute change of loss, percentage points
+#define DEFAULT_GAP_LOSS_THRESHOLD 1.0
+// microseconds, smaller rtt changes are noise
+#define GAP_MIN_RTT_SHIFT 1000
+// gap multiplier after stable round
+#define GAP_GROWTH 1.5
+// weight of new round in baselines
+#define GAP_BASELINE_ALPHA 0.25
+
+
+/* Measurement gap that backs off while channel is stable: every stable round
+ * stretches gap up to max, any shift of abw, rtt or loss against smoothed
+ * baselines drops it back to min.
+ */
+class AdaptiveGap{
+public:
+    // throws if min_gap isn't positive
+    AdaptiveGap(int min_gap, int max_gap, double change_threshold=DEFAULT_GAP_CHANGE_THRESHOLD,
+                double loss_threshold=DEFAULT_GAP_LOSS_THRESHOLD);
+    int update(float abw, int rtt, double loss);    // returns next gap, microseconds
+    int get_gap() const;
+    int get_min_gap() const;
+    int get_max_gap() const;
+private:
+    int m_min_gap;      // microseconds
+    int m_max_gap;      // microseconds
+    int m_gap;          // microseconds
+    double m_change_threshold;
+    double m_loss_threshold;
+    bool m_has_baseline;
+    double m_abw;       // baselines
+    double m_rtt;
+    double m_loss;
+
+    static bool is_shifted(double value, double baseline, double threshold, double min_shift=0);
+};
+
+#endif
@@ -1,88 +1,180 @@
 #include "chest.h"
+#include "util/clock.h"
+#include "util/phase_timer.h"
 #include <thread>
 #include <iostream>
 #include <future>
 #include <fstream>
 #include <csignal>
+#include <sstream>
+
+// bits of one echo request on the wire (IPv4 header without options)
+#define PING_PROBE_BITS ((20 + ICMP_HEADER_LENGTH + sizeof(ProbePayload)) * 8)
 
 // for exponential moving avarage
 #define ABW_ALPHA 0.9
 
-/**
- * Returns a timestamp with microsecond resolution.
- */
-static uint64_t utime(void) {
-    struct timeval now;
-    return gettimeofday(&now, NULL) != 0
-        ? 0
-        : now.tv_sec * 1000000 + now.tv_usec;
-
+// "sec.msec" from microseconds
+static std::string format_time(int64_t time){
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld.%03lld", (long long)(time / 1000000), (long long)(time % 1000000 / 1000));
+    return buf;
 }
 
 /////////////////////////// EndPt
-ChestEndPt::ChestEndPt(): m_ostream(&std::cout, [](std::ostream*){}){};
+ChestEndPt::ChestEndPt(): m_yaml_output(false), m_binary_output(false), m_header_written(false),
+m_ostream(&std::cout, [](std::ostream*){}), m_flush_interval(-1), m_drop_on_overflow(false) {};
 
 void ChestEndPt::set_verbosity(int verbosity){
     m_verbose = verbosity;
 }
 
 void ChestEndPt::set_output_file(const std::string& filename){
+    m_writer.reset();   // writer holds previous stream
+    m_header_written = false;
     m_output_file = filename;
     m_ostream = std::move(std::unique_ptr<std::ostream, std::function<void(std::ostream*)>>
                 (new std::ofstream(filename), std::default_delete<std::ostream>()));
     if (!dynamic_cast<std::ofstream&>(*m_ostream).is_open()){
         throw std::runtime_error("Failed to open file " + filename);
     }
+    if (m_flush_interval >= 0){
+        set_async_output(m_flush_interval, m_drop_on_overflow);
+    }
 }
 
 void ChestEndPt::set_output_format(bool is_yaml){
     m_yaml_output = is_yaml;
 }
 
-namespace stop_handler{
-    bool chest_stopped = false;
+void ChestEndPt::set_binary_output(bool is_binary){
+    m_binary_output = is_binary;
+}
 
-    void stop_chest(int signo){
-        chest_stopped = true;
+void ChestEndPt::set_async_output(int flush_interval, bool drop_on_overflow){
+    m_flush_interval = flush_interval;
+    m_drop_on_overflow = drop_on_overflow;
+    m_writer.reset();
+    m_writer = std::make_unique<AsyncWriter>(*m_ostream, flush_interval,
+        drop_on_overflow ? AsyncWriter::DROP_NEWEST : AsyncWriter::BLOCK);
+}
+
+void ChestEndPt::write_record(std::string&& record){
+    if (m_binary_output && !m_header_written){
+        std::string header;
+        encode_stream_header(header);
+        record.insert(0, header);
+        m_header_written = true;
+    }
+    if (m_writer){
+        m_writer->write(std::move(record));
+    } else {
+        *m_ostream << record << std::flush;
     }
 }
 
+void ChestEndPt::finish_output(){
+    if (!m_writer){
+        return;
+    }
+    uint64_t dropped = m_writer->get_dropped();
+    m_writer.reset();
+    if (dropped != 0){
+        std::cerr << "Output queue overflow: " << dropped << " records dropped" << std::endl;
+    }
+}
+
+namespace stop_handler{
+    bool chest_stopped = false;     // set by SIGINT from signalfd
+}
+
 /////////////////////////// Reciever
-ChestReceiver::ChestReceiver(const ABReceiver& abw_receiver):
-m_abw_receiver(abw_receiver.clone()){};
+ChestReceiver::ChestReceiver(const ABReceiver& abw_receiver){
+    m_abw_receivers.push_back(abw_receiver.clone());
+}
 
-ChestReceiver::ChestReceiver(std::unique_ptr<ABReceiver>& abw_receiver):
-m_abw_receiver(std::move(abw_receiver)) {};
+ChestReceiver::ChestReceiver(std::unique_ptr<ABReceiver>& abw_receiver){
+    add_session(abw_receiver);
+}
 
-// TODO: SIGINT handler to correctly stop Receiver
-void ChestReceiver::run(){
-    if (!m_abw_receiver->validate()){
+void ChestReceiver::add_session(std::unique_ptr<ABReceiver>& abw_receiver){
+    m_abw_receivers.push_back(std::move(abw_receiver));
+}
+
+size_t ChestReceiver::get_sessions_count() const{
+    return m_abw_receivers.size();
+}
+
+void ChestReceiver::run_session(int session){
+    if (!m_abw_receivers[session]->validate()){
+        std::cerr << "Session " << session << ": failed to validate" << std::endl;
         return;
     }
     try{
-        auto abet_res = std::async(std::launch::async, [this](){m_abw_receiver->run();});
+        m_abw_receivers[session]->run();
     } catch (std::exception& e){
-        std::cerr << e.what() << std::endl;
+        std::cerr << "Session " << session << ": " << e.what() << std::endl;
     } catch (...) {}
 }
 
+// TODO: SIGINT handler to correctly stop Receiver
+void ChestReceiver::run(){
+    std::vector<std::future<void>> sessions;
+    for (size_t i = 0; i < m_abw_receivers.size(); i++){
+        sessions.push_back(std::async(std::launch::async, [this, i](){ run_session(i); }));
+    }
+    for (auto& session: sessions){
+        session.wait();
+    }
+}
+
 void ChestReceiver::cleanup(){
-    m_abw_receiver -> cleanup();
+    for (auto& abw_receiver: m_abw_receivers){
+        abw_receiver->cleanup();
+    }
 }
 
 /////////////////////////// Sender
 ChestSender::ChestSender(const ABSender& abw_sender, Pinger& pinger,
                          const LossBase& losser, int measurment_gap):
 m_abw_sender(abw_sender.clone()), m_pinger(pinger.to_unique_ptr()), m_losser(losser.clone()),
-m_measurment_gap(measurment_gap), m_curr_abw_est(0), m_ping_gap(DEFAULT_MEASURMENT_GAP)
+m_measurment_gap(measurment_gap), m_curr_abw_est(0), m_ping_gap(DEFAULT_MEASURMENT_GAP),
+m_ping_seq(0), m_loss_burst_len(0), m_shared_pinger(nullptr), m_ping_target(-1), m_abw_limit(nullptr), m_round_start(0), m_last_abw_cost(0), m_pings_skipped(0),
+m_timer_action(TIMER_NONE), m_series_running(false), m_abw_running(false),
+m_abw_requested(false), m_abw_busy(false), m_abw_exit(false)
 {}
 
 ChestSender::ChestSender(std::unique_ptr<ABSender>& abw_sender, Pinger& pinger,
                 const LossBase& losser, int measurment_gap):
 m_abw_sender(std::move(abw_sender)), m_pinger(pinger.to_unique_ptr()), m_losser(losser.clone()),
-m_measurment_gap(measurment_gap), m_curr_abw_est(0), m_ping_gap(DEFAULT_MEASURMENT_GAP)
+m_measurment_gap(measurment_gap), m_curr_abw_est(0), m_ping_gap(DEFAULT_MEASURMENT_GAP),
+m_ping_seq(0), m_loss_burst_len(0), m_shared_pinger(nullptr), m_ping_target(-1), m_abw_limit(nullptr), m_round_start(0), m_last_abw_cost(0), m_pings_skipped(0),
+m_timer_action(TIMER_NONE), m_series_running(false), m_abw_running(false),
+m_abw_requested(false), m_abw_busy(false), m_abw_exit(false)
 {}
 
+ChestSender::ChestSender(std::unique_ptr<ABSender>& abw_sender,
+                const LossBase& losser, int measurment_gap):
+m_abw_sender(std::move(abw_sender)), m_losser(losser.clone()),
+m_measurment_gap(measurment_gap), m_curr_abw_est(0), m_ping_gap(DEFAULT_MEASURMENT_GAP),
+m_ping_seq(0), m_loss_burst_len(0), m_shared_pinger(nullptr), m_ping_target(-1), m_abw_limit(nullptr), m_round_start(0), m_last_abw_cost(0), m_pings_skipped(0),
+m_timer_action(TIMER_NONE), m_series_running(false), m_abw_running(false),
+m_abw_requested(false), m_abw_busy(false), m_abw_exit(false)
+{}
+
+
+// waits for abw train in progress, it can't be interrupted
+ChestSender::~ChestSender(){
+    {
+        std::lock_guard<std::mutex> lock(m_abw_lock);
+        m_abw_exit = true;
+    }
+    m_abw_cv.notify_one();
+    if (m_abw_thread.joinable()){
+        m_abw_thread.join();
+    }
+}
+
 
 void ChestSender::cleanup(){
     m_abw_sender->cleanup();
@@ -96,6 +188,19 @@ int ChestSender::get_measurment_gap() const{
     return m_measurment_gap;
 }
 
+void ChestSender::set_overhead_budget(std::shared_ptr<TokenBucket> budget){
+    m_budget = budget;
+}
+
+int64_t ChestSender::get_budget_delay(){
+    return m_budget ? m_budget->get_delay(m_last_abw_cost) : 0;
+}
+
+void ChestSender::set_adaptive_gap(int min_gap, int max_gap){
+    m_adaptive_gap = std::make_unique<AdaptiveGap>(min_gap, max_gap);
+    m_measurment_gap = m_adaptive_gap->get_gap();
+}
+
 void ChestSender::set_ping_gap(int ping_gap){
     m_ping_gap = ping_gap;
 }
@@ -104,6 +209,31 @@ int ChestSender::get_ping_gap() const{
     return m_ping_gap;
 }
 
+void ChestSender::set_loss_burst(int burst_len){
+    m_loss_burst_len = burst_len;
+}
+
+int ChestSender::get_loss_burst() const{
+    return m_loss_burst_len;
+}
+
+void ChestSender::set_peer_tag(const std::string& tag){
+    m_peer_tag = tag;
+}
+
+void ChestSender::set_ping_source(MultiPinger* pinger, int target){
+    m_shared_pinger = pinger;
+    m_ping_target = target;
+}
+
+void ChestSender::set_abw_limit(Semaphore* abw_limit){
+    m_abw_limit = abw_limit;
+}
+
+void ChestSender::set_shm_export(const std::string& name){
+    m_shm_export = std::make_unique<ChestShmWriter>(name);
+}
+
 unsigned ChestSender::get_mean_rtt_round() const{
     if (m_rtt_vec_round.size() == 0){
         return 0;
@@ -117,77 +247,171 @@ unsigned ChestSender::get_mean_rtt_round() const{
 
 
 void ChestSender::print_statistics(int runnum){
-    if (m_yaml_output){
-        print_stats_yaml(runnum);
+    publish_snapshot(runnum);
+    std::ostringstream record;
+    print_snapshot(m_snapshot.load(), record);
+    write_record(record.str());
+}
+
+
+void ChestSender::print_snapshot(const ChestSnapshot& snapshot, std::ostream& out) const{
+    PHASE_TIMER(PHASE_OUTPUT);
+    if (m_binary_output){
+        std::string record;
+        encode_record(snapshot, m_peer_tag, record);
+        out.write(record.data(), record.size());
+    } else if (m_yaml_output){
+        print_stats_yaml(snapshot, out);
     } else {
-        print_stats_default(runnum);
+        print_stats_default(snapshot, out);
+    }
+}
+
+
+// called by measurement thread only (single writer)
+void ChestSender::publish_snapshot(int runnum){
+    ChestSnapshot snapshot;
+    snapshot.runnum = runnum;
+    snapshot.time = time_from_start();
+    snapshot.abw = m_curr_abw_est;
+    snapshot.last_rtt = get_mean_rtt_round();
+    snapshot.srtt = m_ping_stats.get_srtt();
+    snapshot.jitter = m_ping_stats.get_jitter();
+    snapshot.rtt_p50 = m_ping_stats.get_rtt_percentile(50);
+    snapshot.rtt_p90 = m_ping_stats.get_rtt_percentile(90);
+    snapshot.rtt_p99 = m_ping_stats.get_rtt_percentile(99);
+    snapshot.rtt_max = m_ping_stats.get_max_rtt();
+    snapshot.loss_total = m_losser->get_total_loss_percentage();
+    snapshot.loss_local = m_losser->get_local_loss_percentage();
+    snapshot.overhead = m_abw_sender->get_last_round_overhead();
+    snapshot.ping_dup = m_pinger ? m_pinger->get_duplicates() : 0;
+    snapshot.ping_reord = m_pinger ? m_pinger->get_reordered() : 0;
+    snapshot.round_time = monotonic_us() - m_round_start;
+    snapshot.gap = m_measurment_gap;
+    snapshot.budget_level = m_budget ? 100 * m_budget->get_level() : 100;
+    snapshot.pings_skipped = m_pings_skipped;
+    m_snapshot.store(snapshot);
+    if (m_shm_export){
+        m_shm_export->publish(snapshot);
     }
 }
 
 
-void ChestSender::print_stats_yaml(int runnum) const{
+ChestSnapshot ChestSender::get_snapshot() const{
+    return m_snapshot.load();
+}
+
+
+uint64_t ChestSender::get_snapshot_version() const{
+    return m_snapshot.get_version();
+}
+
+
+void ChestSender::print_stats_yaml(const ChestSnapshot& snapshot, std::ostream& out) const{
     static bool start = true;
     if (start){
         //ostr << "ChestRes:\n";
         start = false;
     }
-    timeval iter_time = time_from_start();
-    *m_ostream << "-   runnum    : " << runnum << '\n';
-    *m_ostream << "    time      : " << iter_time.tv_sec << '.' << iter_time.tv_usec / 1000 <<  '\n';
-    *m_ostream << "    abw       : " << m_curr_abw_est / 1000000.0  << '\n';
-    *m_ostream << "    lastRtt   : " << get_mean_rtt_round() / 1000. << '\n';
-    *m_ostream << "    sRtt      : " << m_ping_stats.get_srtt() / 1000. << '\n';
-    *m_ostream << "    jitter    : " << m_ping_stats.get_jitter() / 1000. << '\n';
-    *m_ostream << "    loss_total: " << m_losser->get_total_loss_percentage() << '\n';
-    auto local_loss = m_losser->get_local_loss_percentage();
-    if (local_loss >= 0){
-        *m_ostream << "    loss_local: " << local_loss << '\n';
+    out << "-   runnum    : " << snapshot.runnum << '\n';
+    if (!m_peer_tag.empty()){
+        out << "    peer      : " << m_peer_tag << '\n';
+    }
+    out << "    time      : " << format_time(snapshot.time) << '\n';
+    out << "    abw       : " << snapshot.abw / 1000000.0  << '\n';
+    out << "    lastRtt   : " << snapshot.last_rtt / 1000. << '\n';
+    out << "    sRtt      : " << snapshot.srtt / 1000. << '\n';
+    out << "    jitter    : " << snapshot.jitter / 1000. << '\n';
+    out << "    rttP50    : " << snapshot.rtt_p50 / 1000. << '\n';
+    out << "    rttP90    : " << snapshot.rtt_p90 / 1000. << '\n';
+    out << "    rttP99    : " << snapshot.rtt_p99 / 1000. << '\n';
+    out << "    rttMax    : " << snapshot.rtt_max / 1000. << '\n';
+    out << "    loss_total: " << snapshot.loss_total << '\n';
+    if (snapshot.loss_local >= 0){
+        out << "    loss_local: " << snapshot.loss_local << '\n';
     } else {
-        *m_ostream << "    loss_local: null\n";
+        out << "    loss_local: null\n";
+    }
+    out << "    gap_ms    : " << snapshot.gap / 1000. << '\n';
+    if (m_budget){
+        out << "    budget    : " << snapshot.budget_level << '\n';
+        out << "    pings_skipped: " << snapshot.pings_skipped << '\n';
     }
     if (m_verbose){
-        *m_ostream << "    overhead_mbit: " << m_abw_sender->get_last_round_overhead() / 1000000.0 << '\n';
+        out << "    overhead_mbit: " << snapshot.overhead / 1000000.0 << '\n';
+        out << "    ping_dup  : " << snapshot.ping_dup << '\n';
+        out << "    ping_reord: " << snapshot.ping_reord << '\n';
+        out << "    round_time: " << format_time(snapshot.round_time) << '\n';
+        if (phase_timers_enabled()){
+            out << "    phases_ms :\n";
+            print_phase_timers(out, "        ");
+        }
     }
-    *m_ostream << std::endl;
+    out << '\n';
 }
 
 
-void ChestSender::print_stats_default(int runnum) const{
-    if (runnum != -1){
-        timeval iter_time = time_from_start();
-        *m_ostream << iter_time.tv_sec << '.' << iter_time.tv_usec / 1000 << ":"; 
-        *m_ostream << "~~~Printing statistics for run " << runnum << "~~~\n";
+void ChestSender::print_stats_default(const ChestSnapshot& snapshot, std::ostream& out) const{
+    if (!m_peer_tag.empty()){
+        out << '[' << m_peer_tag << "] ";
+    }
+    if (snapshot.runnum != -1){
+        out << format_time(snapshot.time) << ":";
+        out << "~~~Printing statistics for run " << snapshot.runnum << "~~~\n";
+    }
+    out << "Available bw estimation: " << snapshot.abw / 1000000.0 << " mbit/sec\n";
+    out << "Last RTT: " << snapshot.last_rtt / 1000. << "ms";
+    out << "; smoothed RTT: " << snapshot.srtt / 1000. << "ms";
+    out << "; jitter: " << snapshot.jitter / 1000. << "ms\n";
+    out << "RTT p50: " << snapshot.rtt_p50 / 1000. << "ms";
+    out << "; p90: " << snapshot.rtt_p90 / 1000. << "ms";
+    out << "; p99: " << snapshot.rtt_p99 / 1000. << "ms";
+    out << "; max: " << snapshot.rtt_max / 1000. << "ms\n";
+    out << "Total loss percentage: " << snapshot.loss_total << "%\n";
+    if (snapshot.loss_local >= 0){
+        out << "Local loss percentage: " << snapshot.loss_local << "%\n";
     }
-    *m_ostream << "Available bw estimation: " << m_curr_abw_est / 1000000.0 << " mbit/sec\n";
-    *m_ostream << "Last RTT: " << get_mean_rtt_round() / 1000. << "ms";
-    *m_ostream << "; smoothed RTT: " << m_ping_stats.get_srtt() / 1000. << "ms";
-    *m_ostream << "; jitter: " << m_ping_stats.get_jitter() / 1000. << "ms\n";
-    *m_ostream << "Total loss percentage: " << m_losser->get_total_loss_percentage() << "%\n";
-    auto local_loss = m_losser->get_local_loss_percentage();
-    if (local_loss >= 0){
-        *m_ostream << "Local loss percentage: " << local_loss << "%\n";
+    out << "Measurement gap: " << snapshot.gap / 1000. << "ms\n";
+    if (m_budget){
+        out << "Overhead budget left: " << snapshot.budget_level << "%";
+        out << "; pings skipped: " << snapshot.pings_skipped << '\n';
     }
-    *m_ostream << std::endl;
+    out << '\n';
 }
 
 
 void ChestSender::run(){
+    SignalFd signals({SIGINT, SIGUSR1});    // before setup, so other threads inherit blocked mask
     setup();
-    std::unique_ptr<std::list<MeasurementBundle>> 
-    measurement_list = std::make_unique<std::list<MeasurementBundle>>();
-    auto prev_handler = signal(SIGINT, stop_handler::stop_chest);  // break from loop after SIGINT
-    uint64_t tmp_time = 0;
+    m_loop.add_fd(signals.get_fd(), [this, &signals](){
+        int signo;
+        while ((signo = signals.consume()) != 0){
+            if (signo == SIGINT){
+                stop_handler::chest_stopped = true;     // round in progress is dropped
+                m_loop.stop();
+            } else {
+                request_phase_dump(signo);  // dump phase timers on demand
+            }
+        }
+    });
+    int64_t tmp_time = 0;
     for(int runnum=0; !stop_handler::chest_stopped; runnum++){
         if (m_verbose && runnum % 10 == 0 && m_output_file.length() != 0){
             // print round number to cerr to ensure working
             std::cerr << "Round: " << runnum << std::endl;
         }
 
-        tmp_time = utime();
+        tmp_time = timer_clock_us();
         try{
-            chest_sender_single_round(measurement_list, runnum);
+            chest_sender_single_round();
+            if (stop_handler::chest_stopped){
+                break;
+            }
             print_statistics(runnum);
-            measurement_list->clear();
+            if (take_phase_dump_request()){
+                print_phase_timers(std::cerr);
+            }
+            m_round.clear();
             m_rtt_vec_round.clear();
         } catch (std::exception& e) {
             std::cerr << e.what() << std::endl;
@@ -196,17 +420,43 @@ void ChestSender::run(){
             break;
         }
 
-        if (utime() - tmp_time < m_measurment_gap){
-            usleep(m_measurment_gap - (utime() - tmp_time));
+        sleep_until(tmp_time + m_measurment_gap);
+        int64_t budget_delay = get_budget_delay();   // defer round until it fits into budget
+        if (budget_delay > 0 && !stop_handler::chest_stopped){
+            sleep_until(timer_clock_us() + budget_delay);
         }
     }
-    signal(SIGINT, prev_handler);   // return default handler
+    m_loop.remove_fd(signals.get_fd());
+    finish_output();
+}
+
+
+// one round without printing, rethrows measurement errors
+void ChestSender::run_round(int runnum){
+    chest_sender_single_round();
+    publish_snapshot(runnum);
+    m_round.clear();
+    m_rtt_vec_round.clear();
 }
 
 
 void ChestSender::setup(){
     setup_abw();
-    gettimeofday(&m_time_start, 0);
+    if (!m_pinger && !m_shared_pinger){
+        throw std::runtime_error("No ping source");
+    }
+    if (m_pinger && !m_abw_thread.joinable()){
+        m_loop.add_fd(m_pinger->get_fd(), [this](){
+            m_pinger->series_on_readable();
+            if (m_series_running){
+                step_ping_series();
+            }
+        });
+        m_loop.add_fd(m_timer.get_fd(), [this](){ on_timer(); });
+        m_loop.add_fd(m_abw_done.get_fd(), [this](){ on_abw_done(); });
+        m_abw_thread = std::thread(&ChestSender::abw_worker, this);
+    }
+    m_time_start = monotonic_us();
     stop_handler::chest_stopped = false;
     m_rtt_vec_round.clear();
     std::cerr << "Chest prepared!" << std::endl;
@@ -229,80 +479,249 @@ void ChestSender::setup_abw(){
 }
 
 
-// check if std::future got results
-template<typename R>
-bool is_future_ready(std::future<R> const& f){ 
-    return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; 
+// pings go on while abw train is sent, round ends with first series finished after it
+void ChestSender::chest_sender_single_round(){
+    m_round_start = monotonic_us();
+    if (!m_pinger){
+        shared_pinger_round();
+        return;
+    }
+    start_abw_round();
+    start_ping_series();
+    m_loop.run();
+    m_timer.disarm();
+    if (stop_handler::chest_stopped){
+        return;     // SIGINT, abw worker finishes train on its own
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_abw_lock);
+        if (m_abw_error){
+            std::exception_ptr error = m_abw_error;
+            m_abw_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+    process_abw_round();
+    update_measurment_gap();
 }
 
-void ChestSender::
-chest_sender_single_round(std::unique_ptr<std::list<MeasurementBundle>>& measurement_list, int runnum){
-    auto ping_res = std::async(std::launch::async, 
-    [this](){ 
-        return m_pinger->ping(); 
-    });
-    auto abet_res = std::async(std::launch::async, 
-    [this, &measurement_list](){ 
-        return abw_single_round(measurement_list.get()); 
-    });
 
-    while (!is_future_ready(abet_res)){     // ping while abet works
-        auto tmp_res = ping_res.get();
-        process_ping_res(tmp_res);
-        ping_res = std::async(std::launch::async, 
-        [this, &tmp_res](){ 
-            if ((0 <= tmp_res.rtt) && (tmp_res.rtt < m_ping_gap)){
-                usleep(m_ping_gap - tmp_res.rtt);
-            }
-            return m_pinger->ping(); 
-        });
+void ChestSender::start_abw_round(){
+    {
+        std::lock_guard<std::mutex> lock(m_abw_lock);
+        m_abw_requested = true;
+        m_abw_busy = true;
+    }
+    m_abw_running = true;
+    m_abw_cv.notify_one();
+}
+
+
+void ChestSender::abw_worker(){
+    block_all_signals();    // SIGINT is read by measurement loop
+    std::unique_lock<std::mutex> lock(m_abw_lock);
+    for (;;){
+        m_abw_cv.wait(lock, [this](){ return m_abw_requested || m_abw_exit; });
+        if (m_abw_exit){
+            return;
+        }
+        m_abw_requested = false;
+        lock.unlock();
+        std::exception_ptr error;
+        try{
+            abw_single_round();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        m_abw_error = error;
+        m_abw_busy = false;
+        m_abw_done.notify();
     }
+}
+
 
-    abet_res.get();
-    process_abw_round(measurement_list.get());
-    process_ping_res(ping_res.get());
+void ChestSender::on_abw_done(){
+    m_abw_done.consume();
+    {
+        std::lock_guard<std::mutex> lock(m_abw_lock);   // also makes round results visible
+        if (m_abw_busy){
+            return;
+        }
+    }
+    m_abw_running = false;
+    if (!m_series_running){
+        m_loop.stop();
+    }
 }
 
 
-void ChestSender::abw_single_round(std::list<MeasurementBundle>* mb_list){
+void ChestSender::arm_timer(int64_t deadline, TimerAction action){
+    m_timer_action = action;
+    m_timer.arm_at(deadline);
+}
+
+
+void ChestSender::on_timer(){
+    if (!m_timer.consume()){
+        return;
+    }
+    TimerAction action = m_timer_action;
+    m_timer_action = TIMER_NONE;
+    switch (action){
+        case TIMER_PING_STEP:
+            step_ping_series();
+            break;
+        case TIMER_PING_START:
+            start_ping_series();
+            break;
+        case TIMER_WAKEUP:
+            m_loop.stop();
+            break;
+        case TIMER_NONE:
+            break;
+    }
+}
+
+
+void ChestSender::sleep_until(int64_t deadline){
+    if (deadline <= timer_clock_us() || stop_handler::chest_stopped){
+        return;
+    }
+    arm_timer(deadline * 1000, TIMER_WAKEUP);
+    m_loop.run();
+    m_timer.disarm();
+}
+
+
+// local loss reacts faster, total is used until there are enough stats
+void ChestSender::update_measurment_gap(){
+    if (!m_adaptive_gap){
+        return;
+    }
+    double loss = m_losser->get_local_loss_percentage();
+    if (loss < 0){
+        loss = m_losser->get_total_loss_percentage();
+    }
+    m_measurment_gap = m_adaptive_gap->update(m_curr_abw_est, get_mean_rtt_round(), loss);
+}
+
+
+// window-sized series (or loss burst) of probes, sequence numbers continue across series
+void ChestSender::start_ping_series(){
+    int count = m_loss_burst_len > 0 ? m_loss_burst_len : m_pinger->get_window();
+    if (m_budget && !m_budget->try_consume(count * PING_PROBE_BITS)){
+        m_pings_skipped += count;
+        arm_timer(timer_clock_ns() + m_ping_gap * 1000LL, TIMER_PING_START);  // round is shortened to abw train only
+        return;
+    }
+    if (m_loss_burst_len > 0){
+        m_pinger->start_series(m_ping_seq, m_loss_burst_len, 0, -1, m_loss_burst_len);
+    } else {
+        m_pinger->start_series(m_ping_seq, count, m_ping_gap);
+    }
+    m_ping_seq += count;
+    m_series_running = true;
+    step_ping_series();
+}
+
+
+void ChestSender::step_ping_series(){
+    int64_t wakeup = m_pinger->series_step();
+    if (wakeup >= 0){
+        arm_timer(wakeup, TIMER_PING_STEP);
+        return;
+    }
+    m_series_running = false;
+    int last_rtt = process_ping_series(m_pinger->get_series_results());
+    if (!m_abw_running){
+        m_loop.stop();
+        return;
+    }
+    int64_t pause = ((0 <= last_rtt) && (last_rtt < m_ping_gap)) ? m_ping_gap - last_rtt : 0;
+    arm_timer(timer_clock_ns() + pause * 1000, TIMER_PING_START);
+}
+
+
+// returns rtt of last probe in series
+int ChestSender::process_ping_series(const std::vector<PingRes>& series){
+    int seq = m_ping_seq - series.size();
+    for (const auto& ping_res: series){
+        process_ping_res(ping_res, seq++);
+    }
+    if (m_loss_burst_len > 0){
+        m_losser->process_answer(series);   // burst is a packet stream for losser
+    } else {
+        for (const auto& ping_res: series){
+            m_losser->process_answer(ping_res);
+        }
+    }
+    return series.empty() ? -1 : series.back().rtt;
+}
+
+
+void ChestSender::abw_single_round(){
+    SemaphoreGuard abw_guard(m_abw_limit);  // trains of different peers shouldn't interfere
     m_abw_sender->resetRound();
     bool done = false;
-    std::list<MeasurementBundle> tmp_mb_list;
     while (!done){
-        if (!m_abw_sender->doOneMeasurementRound(&tmp_mb_list)){
+        bool measured;
+        {
+            PHASE_TIMER(PHASE_ABW_MEASURE);
+            measured = m_abw_sender->doOneMeasurementRound(&m_tmp_mb_list);
+        }
+        if (!measured){
             //std::cerr << "!! Error collecting measurements from receiver" << std::endl;
             continue;
         }
-        mb_list->insert(mb_list->end(), tmp_mb_list.begin(), tmp_mb_list.end());  // save results
+        m_round.append(m_tmp_mb_list);  // save results, sender still needs its list
 
-        done = m_abw_sender->processOneRoundRes(&tmp_mb_list);   // clears tmp_mb_list
+        PHASE_TIMER(PHASE_ABW_PROCESS);
+        done = m_abw_sender->processOneRoundRes(&m_tmp_mb_list);   // clears m_tmp_mb_list
     }
     return;
 }
 
 
-void ChestSender::process_abw_round(std::list<MeasurementBundle> * mb_list){
-    //std::cout << "Attempts for round:" << mb_list->size() << std::endl;
+// shared pinger probes meanwhile, round takes results of own target
+void ChestSender::shared_pinger_round(){
+    abw_single_round();
+    m_shared_results.clear();
+    m_shared_pinger->take_results(m_ping_target, m_shared_results);
+    for (const auto& result: m_shared_results){
+        process_ping_res(result.res, result.seq);
+        m_losser->process_answer(result.res);
+    }
+    if (m_budget){
+        m_budget->consume(m_shared_results.size() * PING_PROBE_BITS);    // already sent
+    }
+    process_abw_round();
+    update_measurment_gap();
+}
+
+
+void ChestSender::process_abw_round(){
+    //std::cout << "Attempts for round:" << m_round.size() << std::endl;
     m_curr_abw_est = m_abw_sender->get_current_estimation();
     //m_curr_abw_est = ABW_ALPHA * m_abw_sender->get_current_estimation() + (1 - ABW_ALPHA) * m_curr_abw_est;   // exponential moving average
-    m_losser->process_answer(*mb_list);
+    m_losser->process_answer(m_round.span());
+    if (m_budget){
+        m_last_abw_cost = m_abw_sender->get_last_round_overhead();    // known only after round
+        m_budget->consume(m_last_abw_cost);
+    }
     return;
 }
 
 
-void ChestSender::process_ping_res(const PingRes& ping_res){
+void ChestSender::process_ping_res(const PingRes& ping_res, int seq){
     //std::cerr << "In proccess ping" << std::endl;
-    m_ping_stats.process_ping_res(ping_res, -1, false);
-    m_losser->process_answer(ping_res);
+    m_ping_stats.process_ping_res(ping_res, seq, false);
     m_rtt_vec_round.push_back(m_ping_stats.get_last_rtt());
 }
 
 
-timeval ChestSender::time_from_start() const{
-    timeval abs_time, curr_time;
-    gettimeofday(&abs_time, 0);
-    timersub(&abs_time, &m_time_start, &curr_time);
-    return curr_time;
+int64_t ChestSender::time_from_start() const{
+    return monotonic_us() - m_time_start;
 }
 
 
@@ -2,12 +2,26 @@
 #define __ChEst__
 
 #include "abet/abet.h"
+#include "chest_record.h"
+#include "chest_shm.h"
+#include "adaptive_gap.h"
+#include "abet/measurement_round.h"
 #include "ping/pinger.h"
+#include "ping/multi_pinger.h"
 #include "loss/loss.h"
+#include "util/seqlock.h"
+#include "util/semaphore.h"
+#include "util/async_writer.h"
+#include "util/event_loop.h"
+#include "util/token_bucket.h"
 #include <memory>
 #include <iostream>
 #include <functional>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 // microseconds
 #define DEFAULT_MEASURMENT_GAP 100000
@@ -19,42 +33,84 @@ public:
     void set_verbosity(int);
     void set_output_file(const std::string& filename);
     void set_output_format(bool is_yaml=false);
+    void set_binary_output(bool is_binary=true);    // record stream, see chest_record.h
+    // results are written by background thread, flushed every flush_interval (microseconds)
+    void set_async_output(int flush_interval=DEFAULT_WRITER_FLUSH_INTERVAL, bool drop_on_overflow=false);
     virtual ~ChestEndPt() = default;
 protected:
     int m_verbose;
     std::string m_output_file;
     bool m_yaml_output;
+    bool m_binary_output;
+    bool m_header_written;      // binary stream header
     std::unique_ptr<std::ostream, std::function<void(std::ostream*)>> m_ostream;
+    int m_flush_interval;       // microseconds, negative - synchronous output
+    bool m_drop_on_overflow;
+    std::unique_ptr<AsyncWriter> m_writer;  // declared after m_ostream, so destroyed before it
+
+    void write_record(std::string&& record);
+    void finish_output();       // writes queued records and stops writer, reports dropped ones
 };
 
 
+/* Every abw receiver serves one sender session (own control and probe ports),
+ * run() serves all sessions concurrently until they finish.
+ */
 class ChestReceiver: public ChestEndPt{
 public:
     ChestReceiver(const ABReceiver& abw_receiver);
     ChestReceiver(std::unique_ptr<ABReceiver>& abw_receiver);
+    void add_session(std::unique_ptr<ABReceiver>& abw_receiver);
+    size_t get_sessions_count() const;
     virtual void run() override;
 private:
     void cleanup();
-    std::unique_ptr<ABReceiver> m_abw_receiver;
+    void run_session(int session);
+    std::vector<std::unique_ptr<ABReceiver>> m_abw_receivers;
 };
 
 
+/* Measurement thread runs one epoll loop: ping sends, replies and timeouts, pauses
+ * between rounds and SIGINT (signalfd). Abw trains are blocking, so they run in
+ * persistent worker thread which reports end of train through eventfd.
+ * Sender built without Pinger takes pings from MultiPinger shared with other senders
+ * (set_ping_source), its rounds then run abw train in calling thread only.
+ */
 class ChestSender : public ChestEndPt{
 public:
     ChestSender(const ABSender& abw_sender, Pinger& pinger,
                 const LossBase& losser, int measurment_gap=DEFAULT_MEASURMENT_GAP);
     ChestSender(std::unique_ptr<ABSender>& abw_sender, Pinger& pinger,
                 const LossBase& losser, int measurment_gap=DEFAULT_MEASURMENT_GAP);
+    ChestSender(std::unique_ptr<ABSender>& abw_sender,
+                const LossBase& losser, int measurment_gap=DEFAULT_MEASURMENT_GAP);
+    ~ChestSender();
     virtual void run() override;
     void print_statistics(int runnum=-1);
+    // for external schedulers: setup once, then rounds, snapshot published after each
+    void setup();
+    void run_round(int runnum);
+    void print_snapshot(const ChestSnapshot& snapshot, std::ostream& out) const;
+    // thread-safe, never blocks measurement threads
+    ChestSnapshot get_snapshot() const;
+    uint64_t get_snapshot_version() const;
 
     const ABSender* get_abw_sender() const;
-    const Pinger* get_pinger() const;
+    const Pinger* get_pinger() const;       // nullptr with shared pinger
     const LossBase* get_losser() const;
     void set_ping_gap(int ping_gap);
     int get_ping_gap() const;
+    void set_loss_burst(int burst_len);     // 0 - single pings
+    int get_loss_burst() const;
     void set_measurment_gap(int meas_gap);
     int get_measurment_gap() const;
+    void set_adaptive_gap(int min_gap, int max_gap);    // microseconds, gap follows channel stability
+    void set_peer_tag(const std::string& tag);     // printed with every round if not empty
+    void set_ping_source(MultiPinger* pinger, int target);    // pings of target are taken every round
+    void set_abw_limit(Semaphore* abw_limit);       // shared limit of concurrent abw trains
+    void set_shm_export(const std::string& name);   // publish snapshots to /dev/shm/<name>
+    void set_overhead_budget(std::shared_ptr<TokenBucket> budget);  // abw trains and pings, may be shared
+    int64_t get_budget_delay();     // microseconds until next abw round fits into budget
 private:
     std::unique_ptr<ABSender> m_abw_sender;
     std::unique_ptr<Pinger> m_pinger;
@@ -63,20 +119,62 @@ private:
     int m_ping_gap;         // microseconds
     PingStat m_ping_stats;
     float m_curr_abw_est;   // bytes/sec
-    timeval m_time_start;
+    unsigned m_ping_seq;    // next ping sequence number
+    int m_loss_burst_len;   // probes per sendmmsg burst, 0 - no bursts
+    int64_t m_time_start;   // monotonic, microseconds
     std::vector<int> m_rtt_vec_round;   // microseconds, vector of rtt during measurment round
+    SeqLock<ChestSnapshot> m_snapshot;
+    MeasurementRound m_round;                   // bundles of current round
+    std::list<MeasurementBundle> m_tmp_mb_list; // filled and cleared by abw sender
+    std::string m_peer_tag;
+    MultiPinger* m_shared_pinger;   // not owned
+    int m_ping_target;
+    std::vector<MultiPinger::ProbeResult> m_shared_results;
+    Semaphore* m_abw_limit;
+    int64_t m_round_start;  // monotonic, microseconds
+    std::unique_ptr<ChestShmWriter> m_shm_export;
+    std::unique_ptr<AdaptiveGap> m_adaptive_gap;
+    std::shared_ptr<TokenBucket> m_budget;
+    unsigned m_last_abw_cost;   // bits, expected cost of next abw round
+    unsigned m_pings_skipped;   // probes not sent because of budget
 
-    void chest_sender_single_round(std::unique_ptr<std::list<MeasurementBundle>>&, int runnum=-1);
-    void abw_single_round(std::list<MeasurementBundle> *);
-    void setup();
+    enum TimerAction { TIMER_NONE, TIMER_PING_STEP, TIMER_PING_START, TIMER_WAKEUP };
+    EventLoop m_loop;
+    TimerFd m_timer;
+    TimerAction m_timer_action;
+    bool m_series_running;
+    bool m_abw_running;         // as seen by measurement thread
+    EventFd m_abw_done;
+    std::thread m_abw_thread;
+    std::mutex m_abw_lock;      // guards fields below
+    std::condition_variable m_abw_cv;
+    bool m_abw_requested;
+    bool m_abw_busy;
+    bool m_abw_exit;
+    std::exception_ptr m_abw_error;
+
+    void chest_sender_single_round();
+    void abw_single_round();
+    void shared_pinger_round();
+    void abw_worker();
+    void start_abw_round();
+    void on_abw_done();
+    void on_timer();
+    void arm_timer(int64_t deadline, TimerAction action);   // timer clock, nanoseconds
+    void sleep_until(int64_t deadline);     // timer clock, microseconds, returns early on SIGINT
     void setup_abw();
     void cleanup();
-    void process_abw_round(std::list<MeasurementBundle> *);
-    void process_ping_res(const PingRes& ping_res);
-    void print_stats_yaml(int runnum) const;
-    void print_stats_default(int runnum) const;
+    void process_abw_round();
+    void process_ping_res(const PingRes& ping_res, int seq=-1);
+    void start_ping_series();
+    void step_ping_series();
+    int process_ping_series(const std::vector<PingRes>& series);
+    void update_measurment_gap();
+    void publish_snapshot(int runnum);
+    void print_stats_yaml(const ChestSnapshot& snapshot, std::ostream& out) const;
+    void print_stats_default(const ChestSnapshot& snapshot, std::ostream& out) const;
     unsigned get_mean_rtt_round() const;    // microseconds
-    timeval time_from_start() const;
+    int64_t time_from_start() const;    // microseconds
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "chest_record.h"
+#include <stdexcept>
+#include <string.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error "Binary stream is written in host byte order, only little-endian hosts are supported"
+#endif
+
+
+void encode_stream_header(std::string& out){
+    ChestStreamHeader header;
+    memcpy(header.magic, CHEST_STREAM_MAGIC, sizeof(header.magic));
+    header.version = CHEST_STREAM_VERSION;
+    header.record_size = sizeof(ChestRecord);
+    out.append((const char*)&header, sizeof(header));
+}
+
+
+void encode_record(const ChestSnapshot& snapshot, const std::string& tag, std::string& out){
+    ChestRecord record;
+    record.runnum = snapshot.runnum;
+    record.tag_len = tag.size() > UINT16_MAX ? UINT16_MAX : tag.size();
+    record.reserved = 0;
+    record.time = snapshot.time;
+    record.abw = snapshot.abw;
+    record.last_rtt = snapshot.last_rtt;
+    record.srtt = snapshot.srtt;
+    record.jitter = snapshot.jitter;
+    record.rtt_p50 = snapshot.rtt_p50;
+    record.rtt_p90 = snapshot.rtt_p90;
+    record.rtt_p99 = snapshot.rtt_p99;
+    record.rtt_max = snapshot.rtt_max;
+    record.loss_total = snapshot.loss_total;
+    record.loss_local = snapshot.loss_local;
+    record.overhead = snapshot.overhead;
+    record.ping_dup = snapshot.ping_dup;
+    record.ping_reord = snapshot.ping_reord;
+    record.round_time = snapshot.round_time;
+    record.gap = snapshot.gap;
+    record.budget_level = snapshot.budget_level;
+    record.pings_skipped = snapshot.pings_skipped;
+    record.reserved2 = 0;
+    out.append((const char*)&record, sizeof(record));
+    out.append(tag, 0, record.tag_len);
+}
+
+
+void decode_stream_header(std::istream& in){
+    ChestStreamHeader header;
+    if (!in.read((char*)&header, sizeof(header))){
+        throw std::runtime_error("Stream is too short");
+    }
+    if (memcmp(header.magic, CHEST_STREAM_MAGIC, sizeof(header.magic)) != 0){
+        throw std::runtime_error("Not a ChEst binary stream");
+    }
+    if (header.version != CHEST_STREAM_VERSION || header.record_size != sizeof(ChestRecord)){
+        throw std::runtime_error("Unsupported stream version " + std::to_string(header.version));
+    }
+}
+
+
+bool decode_record(std::istream& in, ChestSnapshot& snapshot, std::string& tag){
+    ChestRecord record;
+    if (!in.read((char*)&record, sizeof(record))){
+        if (in.gcount() != 0){
+            throw std::runtime_error("Truncated record");
+        }
+        return false;
+    }
+    tag.resize(record.tag_len);
+    if (record.tag_len != 0 && !in.read(&tag[0], record.tag_len)){
+        throw std::runtime_error("Truncated record");
+    }
+    snapshot.runnum = record.runnum;
+    snapshot.time = record.time;
+    snapshot.abw = record.abw;
+    snapshot.last_rtt = record.last_rtt;
+    snapshot.srtt = record.srtt;
+    snapshot.jitter = record.jitter;
+    snapshot.rtt_p50 = record.rtt_p50;
+    snapshot.rtt_p90 = record.rtt_p90;
+    snapshot.rtt_p99 = record.rtt_p99;
+    snapshot.rtt_max = record.rtt_max;
+    snapshot.loss_total = record.loss_total;
+    snapshot.loss_local = record.loss_local;
+    snapshot.overhead = record.overhead;
+    snapshot.ping_dup = record.ping_dup;
+    snapshot.ping_reord = record.ping_reord;
+    snapshot.round_time = record.round_time;
+    snapshot.gap = record.gap;
+    snapshot.budget_level = record.budget_level;
+    snapshot.pings_skipped = record.pings_skipped;
+    return true;
+}
@@ -0,0 +1,79 @@
+// Binary stream of ChEst round results.
+
+#ifndef __ChestRecord__
+#define __ChestRecord__
+
+#include <stdint.h>
+#include <istream>
+#include <string>
+
+#define CHEST_STREAM_MAGIC "CHST"
+#define CHEST_STREAM_VERSION 1
+
+// Consistent view of sender estimates, published once per round
+struct ChestSnapshot{
+    int runnum;
+    int64_t time;           // microseconds from start
+    float abw;              // bytes/sec
+    int last_rtt;           // microseconds, mean over round
+    int srtt;               // microseconds
+    int jitter;             // microseconds
+    int rtt_p50;            // microseconds
+    int rtt_p90;
+    int rtt_p99;
+    int rtt_max;
+    double loss_total;      // percentage
+    double loss_local;      // percentage, negative if not enough stats
+    unsigned overhead;      // bits in last abw round
+    unsigned ping_dup;
+    unsigned ping_reord;
+    int round_time;         // microseconds, duration of last round
+    int gap;                // microseconds, before next round
+    float budget_level;     // percentage of overhead budget left, negative in debt
+    unsigned pings_skipped; // because of overhead budget
+};
+
+
+/* Stream: header, then records. Record is fixed-layout little-endian struct
+ * followed by tag_len bytes of peer tag (empty for single receiver).
+ */
+struct ChestStreamHeader{
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;   // sizeof(ChestRecord) of writer
+};
+
+struct ChestRecord{
+    int32_t runnum;
+    uint16_t tag_len;
+    uint16_t reserved;
+    int64_t time;           // microseconds from start
+    float abw;              // bytes/sec
+    int32_t last_rtt;       // microseconds
+    int32_t srtt;
+    int32_t jitter;
+    int32_t rtt_p50;
+    int32_t rtt_p90;
+    int32_t rtt_p99;
+    int32_t rtt_max;
+    double loss_total;      // percentage
+    double loss_local;      // percentage, negative if not enough stats
+    uint32_t overhead;      // bits
+    uint32_t ping_dup;
+    uint32_t ping_reord;
+    int32_t round_time;     // microseconds
+    int32_t gap;            // microseconds
+    float budget_level;     // percentage
+    uint32_t pings_skipped;
+    uint32_t reserved2;
+};
+static_assert(sizeof(ChestRecord) == 96, "ChestRecord layout is part of stream format");
+
+
+void encode_stream_header(std::string& out);     // appends
+void encode_record(const ChestSnapshot& snapshot, const std::string& tag, std::string& out);   // appends
+
+void decode_stream_header(std::istream& in);     // throws on bad stream
+bool decode_record(std::istream& in, ChestSnapshot& snapshot, std::string& tag);   // false at end of stream
+
+#endif
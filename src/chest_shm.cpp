@@ -0,0 +1,102 @@
+#include "chest_shm.h"
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// region is built in temporary file and renamed over old one: readers
+// still mapping previous region keep it, it's never truncated under them
+ChestShmWriter::ChestShmWriter(const std::string& name){
+    std::string path = CHEST_SHM_DIR + name;
+    std::string tmp_path = CHEST_SHM_DIR "." + name + "." + std::to_string(getpid());
+    int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0){
+        throw std::runtime_error("Failed to open " + tmp_path + ": " + strerror(errno));
+    }
+    if (ftruncate(fd, sizeof(ChestShmRegion)) < 0){
+        close(fd);
+        unlink(tmp_path.c_str());
+        throw std::runtime_error("Failed to resize " + tmp_path + ": " + strerror(errno));
+    }
+    void* addr = mmap(NULL, sizeof(ChestShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED){
+        unlink(tmp_path.c_str());
+        throw std::runtime_error("Failed to map " + tmp_path + ": " + strerror(errno));
+    }
+    m_region = new (addr) ChestShmRegion;   // seqlock constructor zeroes snapshot
+    m_region->version = CHEST_SHM_VERSION;
+    m_region->snapshot_size = sizeof(ChestSnapshot);
+    m_region->pid = getpid();
+    m_region->reserved = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_region->magic, CHEST_SHM_MAGIC, sizeof(m_region->magic));    // region is ready
+    if (rename(tmp_path.c_str(), path.c_str()) < 0){
+        int err = errno;
+        munmap(addr, sizeof(ChestShmRegion));
+        unlink(tmp_path.c_str());
+        throw std::runtime_error("Failed to rename " + tmp_path + " to " + path + ": " + strerror(err));
+    }
+}
+
+
+ChestShmWriter::~ChestShmWriter(){
+    munmap(m_region, sizeof(ChestShmRegion));
+}
+
+
+void ChestShmWriter::publish(const ChestSnapshot& snapshot){
+    m_region->snapshot.store(snapshot);
+}
+
+
+ChestShmReader::ChestShmReader(const std::string& name){
+    std::string path = CHEST_SHM_DIR + name;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ChestShmRegion)){
+        close(fd);
+        throw std::runtime_error(path + " is not a ChEst region");
+    }
+    void* addr = mmap(NULL, sizeof(ChestShmRegion), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED){
+        throw std::runtime_error("Failed to map " + path + ": " + strerror(errno));
+    }
+    m_region = (const ChestShmRegion*)addr;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (memcmp(m_region->magic, CHEST_SHM_MAGIC, sizeof(m_region->magic)) != 0 ||
+        m_region->version != CHEST_SHM_VERSION || m_region->snapshot_size != sizeof(ChestSnapshot)){
+        munmap(addr, sizeof(ChestShmRegion));
+        throw std::runtime_error(path + " is not a compatible ChEst region");
+    }
+}
+
+
+ChestShmReader::~ChestShmReader(){
+    munmap((void*)m_region, sizeof(ChestShmRegion));
+}
+
+
+ChestSnapshot ChestShmReader::load() const{
+    return m_region->snapshot.load();
+}
+
+
+uint64_t ChestShmReader::get_version() const{
+    return m_region->snapshot.get_version();
+}
+
+
+pid_t ChestShmReader::get_writer_pid() const{
+    return m_region->pid;
+}
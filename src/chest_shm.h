@@ -0,0 +1,53 @@
+// Live export of latest sender snapshot through shared memory.
+
+#ifndef __ChestShm__
+#define __ChestShm__
+
+#include "chest_record.h"
+#include "util/seqlock.h"
+#include <string>
+
+#define CHEST_SHM_DIR "/dev/shm/"
+#define CHEST_SHM_MAGIC "CHSM"
+#define CHEST_SHM_VERSION 2
+
+
+/* Region layout. Writer fills header, then sets magic, readers poll snapshot
+ * through seqlock: no syscalls and no locks on either side after mapping.
+ */
+struct ChestShmRegion{
+    char magic[4];
+    uint16_t version;
+    uint16_t snapshot_size;     // sizeof(ChestSnapshot) of writer
+    uint32_t pid;               // writer process
+    uint32_t reserved;
+    SeqLock<ChestSnapshot> snapshot;
+};
+
+
+class ChestShmWriter{
+public:
+    explicit ChestShmWriter(const std::string& name);   // creates /dev/shm/<name>, replaces old one atomically
+    ChestShmWriter(const ChestShmWriter& other) = delete;
+    ChestShmWriter& operator=(const ChestShmWriter& other) = delete;
+    ~ChestShmWriter();      // unmaps, file is left for readers
+    void publish(const ChestSnapshot& snapshot);    // single writer
+private:
+    ChestShmRegion* m_region;
+};
+
+
+class ChestShmReader{
+public:
+    explicit ChestShmReader(const std::string& name);   // throws if region is missing or incompatible
+    ChestShmReader(const ChestShmReader& other) = delete;
+    ChestShmReader& operator=(const ChestShmReader& other) = delete;
+    ~ChestShmReader();
+    ChestSnapshot load() const;
+    uint64_t get_version() const;   // number of published snapshots
+    pid_t get_writer_pid() const;
+private:
+    const ChestShmRegion* m_region;
+};
+
+#endif
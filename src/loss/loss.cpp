@@ -1,6 +1,9 @@
 #include "loss.h"
+#include "../util/phase_timer.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <stdexcept>
 #include <yaml-cpp/yaml.h>
 
 //////////////// LossBase ///////////////////
@@ -9,6 +12,12 @@ void LossBase::set_verbosity(int verb_level){
     m_verbose = verb_level;
 }
 
+void LossBase::process_answer(const std::vector<PingRes>& burst){
+    for (const auto& ping_res: burst){
+        process_answer(ping_res);
+    }
+}
+
 void LossBase::serialize_to_file(const std::string& filename) const {
     std::cerr << "This losser doesn't support serialization, nothing will be done" << std::endl;
 }
@@ -39,8 +48,8 @@ void LossDumb::process_answer(const PingRes& ping_res){
     }
 }
 
-void LossDumb::process_answer(const std::list<MeasurementBundle>& mb_list){
-    for (const auto& mb: mb_list){
+void LossDumb::process_answer(const MeasurementSpan& mb_span){
+    for (const auto& mb: mb_span){
         m_nsamples += mb.m_remote_nsamples;
         m_nlost += mb.m_remote_nlost;
     }
@@ -52,8 +61,9 @@ std::unique_ptr<LossBase> LossDumb::clone() const{
 
 
 //////////////// LossElr ///////////////////
-LossElr::LossElr(unsigned consistency_threshold, int tau_nsteps): m_tau_nsteps(tau_nsteps),
-m_nlost(0), m_nsamples(0), m_consistency_threshold(consistency_threshold) 
+LossElr::LossElr(unsigned consistency_threshold, int tau_nsteps, int delay_bucket): m_nlost(0),
+m_nsamples(0), m_tau_nsteps(tau_nsteps), m_consistency_threshold(consistency_threshold),
+m_delay_bucket(delay_bucket < 1 ? 1 : delay_bucket), m_nbuckets(0), m_round_npackets(0), m_big_sum(0)
 {};
 
 std::unique_ptr<LossBase> LossElr::clone() const {
@@ -61,62 +71,195 @@ std::unique_ptr<LossBase> LossElr::clone() const {
 }
 
 
-// used for delays, in general case can lead to overflows
-int get_millisec(const timeval& tv){
-    if (tv.tv_sec == -1){
-        return -1;  
+int LossElr::get_delay_bucket() const{
+    return m_delay_bucket;
+}
+
+
+void LossElr::set_workers(std::shared_ptr<TaskPool> pool){
+    m_pool = pool;
+}
+
+
+int LossElr::get_bucket(int32_t delay) const{
+    return std::min(delay / m_delay_bucket, ELR_MAX_DELAY_BUCKETS - 1);
+}
+
+
+static size_t grow_buckets(size_t nbuckets, int bucket){
+    nbuckets = std::max(nbuckets, (size_t)1);
+    while (nbuckets <= (size_t)bucket){
+        nbuckets *= 2;
+    }
+    return std::min(nbuckets, (size_t)ELR_MAX_DELAY_BUCKETS);
+}
+
+
+LossElr::PktCount* LossElr::get_pkt_counts(int bucket){
+    const size_t row_size = m_tau_nsteps * 2 + 1;
+    if ((size_t)bucket >= m_nbuckets){
+        m_nbuckets = grow_buckets(m_nbuckets, bucket);
+        m_probabilities.resize(m_nbuckets * row_size);     // default construct
+        m_integrals.resize(m_nbuckets, 0);
+        m_hits.resize(m_nbuckets, 0);
+        m_new_hits.resize(m_nbuckets, 0);
+        m_dirty.resize(m_nbuckets, 0);
     }
-    int res = (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
-    return (res < 0 || res > 1000000) ? -1 : res;
+    return m_probabilities.data() + bucket * row_size;
 }
 
 
-std::vector<LossElr::PktCount>& LossElr::get_pkt_count_vec(int delay){
-    if (m_probabilities.count(delay) == 0){
-        m_probabilities[delay] = std::vector<LossElr::PktCount>(m_tau_nsteps * 2 + 1);  // defaut construct
+// every counted packet adds to its own position, so used row has non-zero center
+bool LossElr::is_bucket_used(size_t bucket) const{
+    return bucket < m_nbuckets && m_probabilities[bucket * (m_tau_nsteps * 2 + 1) + m_tau_nsteps].ntotal != 0;
+}
+
+
+LossElr::Shard& LossElr::get_shard(int idx){
+    if (m_shards.size() <= (size_t)idx){
+        m_shards.resize(idx + 1);
     }
-    return m_probabilities[delay];
+    return m_shards[idx];
 }
 
 
-// Also save delays for all non-lost packets in mb
-void LossElr::count_stats(const MeasurementBundle& mb){
-    const std::vector<timeval>& delay_vec = mb.m_delays_vec;
+/* Counts delay buckets of all non-lost packets of stream into shard.
+ * Window is [pkt_idx - tau, pkt_idx + tau] clamped to stream: ntotal of all its offsets
+ * grows by one, so only range ends are marked; nlost grows only at lost packets,
+ * found through bitmap. Cost per packet doesn't depend on tau when losses are rare.
+ */
+void LossElr::count_stats(const PacketDelays& delays, Shard& shard) const{
+    const int32_t* delay_us = delays.delays();
+    const int row_size = m_tau_nsteps * 2 + 1;
     int pkt_idx = 0;
-    int n_packets = delay_vec.size();
-    for (const auto& tv : delay_vec){
-        int delay = get_millisec(tv);
-        if (delay == -1){
+    int n_packets = delays.size();
+    for (int j = 0; j < n_packets; j++){
+        if (delay_us[j] == -1){
             continue;   // skip lost packet
         }
-        m_delay_vec.push_back(delay);
-        // ..choose bucket.. (possible feature for 'delay resolution') //
-        std::vector<PktCount>& pkt_count_vec = get_pkt_count_vec(delay);    // CHECK: mb reference to local var
-        for (int i = -m_tau_nsteps; i <= m_tau_nsteps; i++){
-            int tmp_idx = pkt_idx + i;  // TOCHECK
-            if (tmp_idx < 0 || tmp_idx >= n_packets){
-                continue;   
-            }
-            
-            if (delay_vec[tmp_idx].tv_sec == -1){
-                pkt_count_vec[i+m_tau_nsteps].nlost += 1;
-            }
-            pkt_count_vec[i+m_tau_nsteps].ntotal += 1;
+        int bucket = get_bucket(delay_us[j]);
+        if ((size_t)bucket >= shard.hits.size()){
+            size_t nbuckets = grow_buckets(shard.hits.size(), bucket);
+            shard.nlost.resize(nbuckets * row_size, 0);
+            shard.total_diff.resize(nbuckets * (row_size + 1), 0);
+            shard.hits.resize(nbuckets, 0);
+        }
+        if (shard.hits[bucket]++ == 0){
+            shard.touched.push_back(bucket);
         }
+        shard.npackets += 1;
+        int first = std::max(pkt_idx - m_tau_nsteps, 0);    // TOCHECK
+        int last = std::min(pkt_idx + m_tau_nsteps, n_packets - 1);
+        int* total_diff = shard.total_diff.data() + bucket * (row_size + 1);
+        total_diff[first - pkt_idx + m_tau_nsteps] += 1;
+        total_diff[last - pkt_idx + m_tau_nsteps + 1] -= 1;
+        unsigned* nlost = shard.nlost.data() + bucket * row_size;
+        const int window_start = pkt_idx - m_tau_nsteps;     // stream index of offset 0
+        delays.for_each_lost(first, last + 1, [nlost, window_start](size_t k){
+            nlost[(int)k - window_start] += 1;
+        });
         pkt_idx += 1;
     }
 }
 
 
-void LossElr::process_answer(const std::list<MeasurementBundle>& mb_list){
-    m_delay_vec.clear();    // clear previous round res
-    for (const auto& mb : mb_list){
-        // space for parallelism
+/* Adds shard counts to table (ntotal through prefix sum) and leaves shard empty.
+ * Packets of abw round (round_packets) are also the packets local loss is estimated for.
+ */
+void LossElr::merge_shard(Shard& shard, bool round_packets){
+    const size_t row_size = m_tau_nsteps * 2 + 1;
+    for (int bucket: shard.touched){
+        PktCount* row = get_pkt_counts(bucket);
+        unsigned* nlost = shard.nlost.data() + bucket * row_size;
+        int* total_diff = shard.total_diff.data() + bucket * (row_size + 1);
+        int total = 0;
+        for (size_t j = 0; j < row_size; j++){
+            total += total_diff[j];
+            row[j].ntotal += total;
+            row[j].nlost += nlost[j];
+            total_diff[j] = 0;
+            nlost[j] = 0;
+        }
+        total_diff[row_size] = 0;
+
+        if (round_packets){
+            if (m_hits[bucket] == 0){
+                m_round_buckets.push_back(bucket);
+            }
+            m_hits[bucket] += shard.hits[bucket];
+            m_new_hits[bucket] += shard.hits[bucket];
+        }
+        shard.hits[bucket] = 0;
+        if (!m_dirty[bucket]){
+            m_dirty[bucket] = 1;
+            m_touched.push_back(bucket);
+        }
+    }
+    shard.touched.clear();
+    if (round_packets){
+        m_round_npackets += shard.npackets;
+    }
+    shard.npackets = 0;
+}
+
+
+// recomputes integrals of changed rows and corrects big_sum: hits counted before
+// change had old integral; sorted, so sum doesn't depend on merge order
+void LossElr::flush_buckets(){
+    std::sort(m_touched.begin(), m_touched.end());
+    for (int bucket: m_touched){
+        double integral = compute_integral(bucket);
+        m_big_sum += m_new_hits[bucket] * m_integrals[bucket] + m_hits[bucket] * (integral - m_integrals[bucket]);
+        m_integrals[bucket] = integral;
+        m_new_hits[bucket] = 0;
+        m_dirty[bucket] = 0;
+    }
+    m_touched.clear();
+}
+
+
+void LossElr::start_round(){
+    for (int bucket: m_round_buckets){
+        m_hits[bucket] = 0;
+    }
+    m_round_buckets.clear();
+    m_round_npackets = 0;
+    m_big_sum = 0;
+}
+
+
+// shard i takes i-th consecutive part of bundles, merge order is bundle order
+void LossElr::process_answer(const MeasurementSpan& mb_span){
+    PHASE_TIMER(PHASE_LOSS_PROCESS);
+    start_round();      // clear previous round res
+    for (const auto& mb : mb_span){
         m_nsamples += mb.m_remote_nsamples;
         m_nlost += mb.m_remote_nlost;
         // maybe save time start and time end, but not now
-        count_stats(mb);
     }
+    int nshards = 1;
+    if (m_pool && mb_span.size() >= ELR_MIN_BUNDLES_PER_SHARD * 2){
+        nshards = std::min((size_t)m_pool->get_threads_count() + 1, mb_span.size() / ELR_MIN_BUNDLES_PER_SHARD);
+    }
+    get_shard(nshards - 1);
+    auto count_part = [this, &mb_span, nshards](int idx){
+        Shard& shard = m_shards[idx];
+        size_t first = mb_span.size() * idx / nshards;
+        size_t last = mb_span.size() * (idx + 1) / nshards;
+        for (size_t i = first; i < last; i++){
+            shard.stream.assign(mb_span[i].m_delays_vec);
+            count_stats(shard.stream, shard);
+        }
+    };
+    if (nshards > 1){
+        m_pool->run(nshards, count_part);
+    } else {
+        count_part(0);
+    }
+    for (int i = 0; i < nshards; i++){
+        merge_shard(m_shards[i], true);
+    }
+    flush_buckets();
 }
 
 void LossElr::process_answer(const PingRes& ping_res){
@@ -126,6 +269,23 @@ void LossElr::process_answer(const PingRes& ping_res){
     }
 }
 
+/* Burst of echo probes is one more packet stream for stats table, rtt/2 is taken as one-way delay.
+ * Local loss stays estimated for packets of last abw round, burst only changes their probabilities.
+ */
+void LossElr::process_answer(const std::vector<PingRes>& burst){
+    Shard& shard = get_shard(0);
+    shard.stream.clear();
+    shard.stream.reserve(burst.size());
+    for (const auto& ping_res: burst){
+        shard.stream.push_back(ping_res.rtt == -1 ? -1 : ping_res.rtt / 2);
+    }
+    m_nsamples += burst.size();
+    m_nlost += shard.stream.get_nlost();
+    count_stats(shard.stream, shard);
+    merge_shard(shard, false);
+    flush_buckets();
+}
+
 
 double LossElr::get_total_loss_percentage() const {
     if (m_nsamples != 0){
@@ -136,17 +296,14 @@ double LossElr::get_total_loss_percentage() const {
 }
 
 
-// right-rectangle formula; pkt_idx - index in m_delay_vec
-double LossElr::compute_integral(int pkt_idx) const{
-    auto pkt_count_vec_it = m_probabilities.find(m_delay_vec[pkt_idx]);
-    if (pkt_count_vec_it == m_probabilities.end()){
-        std::cerr << "Error: new delay while compute_integral" << std::endl;
-        return 0;
-    }
-    const std::vector<PktCount>& stat_vec = pkt_count_vec_it->second;
-    
+// right-rectangle formula over row of delay bucket
+double LossElr::compute_integral(size_t bucket) const{
+    const size_t row_size = m_tau_nsteps * 2 + 1;
+    const PktCount* row = m_probabilities.data() + bucket * row_size;
+
     double small_sum = 0;
-    for (const auto& pkt_count: stat_vec){
+    for (size_t j = 0; j < row_size; j++){
+        const PktCount& pkt_count = row[j];
         if (pkt_count.ntotal == 0 || pkt_count.nlost == 0){
             continue;
         }
@@ -165,24 +322,25 @@ l_c(j, Y) = m_probabilities[Y][j].nlost / m_probabilities[Y][j].ntotal;
 N+ and N- are assumed equal to m_tau_nsteps
 */
 double LossElr::get_local_loss_percentage() const{
-    if (m_nlost < m_consistency_threshold){
+    PHASE_TIMER(PHASE_LOSS_LOCAL);
+    if (m_nlost < m_consistency_threshold || m_round_npackets == 0){
         return -1;
     }
-    double big_sum = 0; 
-    for (int i = 0; i < m_delay_vec.size(); i++){
-        big_sum += compute_integral(i);
-    }
-
-    big_sum /= (m_delay_vec.size() * (m_tau_nsteps * 2 + 1));
+    double big_sum = m_big_sum / (m_round_npackets * (m_tau_nsteps * 2 + 1.));
     return big_sum * 100;   // to percentage
 }
 
 
 void LossElr::print_probabilities() const{
-    for (const auto& elem: m_probabilities){
-        std::cout << "Delay: " << elem.first << "ms\n";
+    const size_t row_size = m_tau_nsteps * 2 + 1;
+    for (size_t bucket = 0; bucket < m_nbuckets; bucket++){
+        if (!is_bucket_used(bucket)){
+            continue;
+        }
+        std::cout << "Delay: " << bucket * m_delay_bucket / 1000. << "ms\n";
         std::cout << '[';
-        for (const auto& pkt_cnt: elem.second){
+        for (size_t j = 0; j < row_size; j++){
+            const PktCount& pkt_cnt = m_probabilities[bucket * row_size + j];
             std::cout << '{' << pkt_cnt.nlost << ", " << pkt_cnt.ntotal << "}, ";
         }
         std::cout << "]\n";
@@ -228,15 +386,22 @@ void LossElr::serialize_to_file(const std::string& filename) const{
     emmiter << YAML::Key << "m_nsamples" << YAML::Value << m_nsamples;
     emmiter << YAML::Key << "m_tau_nsteps" << YAML::Value << m_tau_nsteps; 
     emmiter << YAML::Comment("Don't change!");
-    
+    emmiter << YAML::Key << "m_delay_bucket" << YAML::Value << m_delay_bucket;
+    emmiter << YAML::Comment("microseconds");
+
+    // key is delay bucket, same as delay in ms for default bucket
+    const size_t row_size = m_tau_nsteps * 2 + 1;
     emmiter << YAML::Key << "m_probabilities";
     emmiter << YAML::BeginMap;
-    for (const auto& elem: m_probabilities){
-        emmiter << YAML::Key << elem.first;
+    for (size_t bucket = 0; bucket < m_nbuckets; bucket++){
+        if (!is_bucket_used(bucket)){
+            continue;
+        }
+        emmiter << YAML::Key << bucket;
         emmiter << YAML::Value;
         emmiter << YAML::BeginSeq;
-        for (const auto& pkt_count: elem.second){
-            emmiter << pkt_count;
+        for (size_t j = 0; j < row_size; j++){
+            emmiter << m_probabilities[bucket * row_size + j];
         }
         emmiter << YAML::EndSeq;
     }
@@ -254,18 +419,43 @@ void LossElr::deserialize_from_file(const std::string& filename){
     m_nlost = elr["m_nlost"].as<unsigned int>();
     m_nsamples = elr["m_nsamples"].as<unsigned int>();
     m_tau_nsteps = elr["m_tau_nsteps"].as<int>();
-    m_probabilities = std::move(elr["m_probabilities"].as<elr_probs>());
+    m_delay_bucket = elr["m_delay_bucket"] ? elr["m_delay_bucket"].as<int>() : DEFAULT_DELAY_BUCKET;
+    if (m_delay_bucket < 1){
+        throw std::runtime_error("Bad delay bucket in " + filename);
+    }
+    m_probabilities.clear();
+    m_shards.clear();   // rows depend on tau
+    m_integrals.clear();
+    m_hits.clear();
+    m_new_hits.clear();
+    m_dirty.clear();
+    m_touched.clear();
+    m_round_buckets.clear();
+    m_nbuckets = 0;
+    start_round();
+    const size_t row_size = m_tau_nsteps * 2 + 1;
+    for (const auto& elem: elr["m_probabilities"]){
+        int bucket = elem.first.as<int>();
+        const YAML::Node& counts = elem.second;
+        if (bucket < 0 || bucket >= ELR_MAX_DELAY_BUCKETS || counts.size() != row_size){
+            throw std::runtime_error("Bad ELR stats row in " + filename);
+        }
+        PktCount* row = get_pkt_counts(bucket);
+        for (size_t j = 0; j < row_size; j++){
+            row[j] = counts[j].as<PktCount>();
+        }
+        m_integrals[bucket] = compute_integral(bucket);
+    }
 }
 
 
 void LossElr::fill_probs_random(unsigned int size){
     srand((unsigned)time(0));
     for (int i = 0; i < size; i++){
-        std::vector<PktCount> delay_vec;
-        delay_vec.reserve(2*m_tau_nsteps+1);
+        PktCount* row = get_pkt_counts(i);
         for (int j = 0; j < 2*m_tau_nsteps+1; j++){
-            delay_vec.emplace_back(PktCount(rand() % 1000, rand() % 100000));
+            row[j] = PktCount(rand() % 1000, rand() % 100000);
         }
-        m_probabilities[i] = delay_vec;
+        m_integrals[i] = compute_integral(i);
     }
 }
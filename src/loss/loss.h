@@ -3,14 +3,25 @@
 
 #include "../ping/pinger.h"
 #include "../abet/abet.h"
+#include "../abet/measurement_round.h"
+#include "packet_delays.h"
+#include "../util/task_pool.h"
 #include <memory>
 #include <list>
-#include <unordered_map>
 #include <vector>
 
 // packets
 #define TAU_NSTEPS 5
 
+// microseconds, delay resolution of ELR stats
+#define DEFAULT_DELAY_BUCKET 1000
+
+// ELR table rows, bigger delays share the last bucket
+#define ELR_MAX_DELAY_BUCKETS 65536
+
+// abw round is split between threads only if every thread gets that many streams
+#define ELR_MIN_BUNDLES_PER_SHARD 4
+
 // Elr stats consistency (lost packets)
 #define ELR_CONSISTENCY_THRESHOLD 500
 
@@ -20,7 +31,8 @@ public:
     virtual double get_local_loss_percentage() const = 0;
     virtual std::unique_ptr<LossBase> clone() const = 0;
     virtual void process_answer(const PingRes& ping_res) = 0;
-    virtual void process_answer(const std::list<MeasurementBundle>& mb) = 0;
+    virtual void process_answer(const MeasurementSpan& mb_span) = 0;
+    virtual void process_answer(const std::vector<PingRes>& burst);
 
     virtual void serialize_to_file(const std::string& filename) const;
     virtual void deserialize_from_file(const std::string& filename);
@@ -33,10 +45,11 @@ protected:
 class LossDumb: public LossBase{
 public:
     LossDumb(): m_nlost(0), m_nsamples(0) {};
+    using LossBase::process_answer;
     virtual double get_total_loss_percentage() const override;
     virtual double get_local_loss_percentage() const override;
     virtual void process_answer(const PingRes& ping_res) override;
-    virtual void process_answer(const std::list<MeasurementBundle>& mb_list) override;
+    virtual void process_answer(const MeasurementSpan& mb_span) override;
     virtual std::unique_ptr<LossBase> clone() const override;
 private:
     unsigned int m_nlost;
@@ -50,14 +63,19 @@ private:
 // Warning: stats can overflow (unsigned int) in about 2-3 months of continous work
 class LossElr: public LossBase{
 public:
-    LossElr(unsigned consistency_threshold=ELR_CONSISTENCY_THRESHOLD, int tau_nsteps=TAU_NSTEPS);
+    LossElr(unsigned consistency_threshold=ELR_CONSISTENCY_THRESHOLD, int tau_nsteps=TAU_NSTEPS,
+            int delay_bucket=DEFAULT_DELAY_BUCKET);
     virtual double get_total_loss_percentage() const override;
     virtual double get_local_loss_percentage() const override;
     virtual std::unique_ptr<LossBase> clone() const override;
-    virtual void process_answer(const std::list<MeasurementBundle>& mb_list) override;
+    virtual void process_answer(const MeasurementSpan& mb_span) override;
     virtual void process_answer(const PingRes& ping_res) override;
+    virtual void process_answer(const std::vector<PingRes>& burst) override;
     void print_probabilities() const;
     void fill_probs_random(unsigned int size=25);   // for debug
+    int get_delay_bucket() const;   // microseconds
+    // streams of abw round are counted by pool threads, pool may be shared by clones
+    void set_workers(std::shared_ptr<TaskPool> pool);
 
     struct PktCount{
         unsigned int nlost;
@@ -68,25 +86,57 @@ public:
     // to yml format
     virtual void serialize_to_file(const std::string& filename) const override;
 
-    // from yml format
+    // from yml format, delay bucket of file replaces current one
     virtual void deserialize_from_file(const std::string& filename) override;
 private:
     unsigned int m_nlost;
     unsigned int m_nsamples;
     int m_tau_nsteps;  // packets
     unsigned int m_consistency_threshold;   // lost packets
-    std::vector<int> m_delay_vec;
+    int m_delay_bucket;     // microseconds
 
     /*OLD: delay(ms) : [t_send - 50*10, t_send -50*9, ..., t_send, t_send + 50, ... t_send + 50*10], elem {n_lost, n_total} */
-    /*NEW: delay(ms) : [pkt_idx-5, pkt_idx-4, ..., pkt_idx, ..., pkt_idx+5], elem {n_lost, n_total}*/
+    /*NEW: delay bucket : [pkt_idx-5, pkt_idx-4, ..., pkt_idx, ..., pkt_idx+5], elem {n_lost, n_total}*/
+
+    // Dense table: row of bucket b starts at b * (2 * tau + 1), rows are added by doubling
+    std::vector<PktCount> m_probabilities;
+    size_t m_nbuckets;
+
+    /* Counts of consecutive streams, merged into table in stream order. Counts are integers,
+     * so table doesn't depend on number of shards. Storage is kept between rounds.
+     */
+    struct Shard{
+        PacketDelays stream;            // columns of currently processed stream
+        std::vector<unsigned> nlost;    // row of 2 * tau + 1 per bucket
+        // window of packet is range of offsets: ntotal marks range ends, row of 2 * tau + 2
+        std::vector<int> total_diff;
+        std::vector<unsigned> hits;     // received packets per bucket
+        std::vector<int> touched;       // buckets with hits
+        unsigned npackets;
+        Shard(): npackets(0) {};
+    };
+    std::vector<Shard> m_shards;
+    std::shared_ptr<TaskPool> m_pool;
 
-    // Should be 'buckets' for delays but now every delay (ms) is a key
-    using elr_probs = std::unordered_map<int, std::vector<PktCount>>;
-    elr_probs m_probabilities;
+    // Local loss is kept incrementally: big_sum = sum_b hits[b] * integral[b] over last round
+    std::vector<double> m_integrals;    // per bucket, recomputed only when its counters change
+    std::vector<unsigned> m_hits;       // received packets of last round per bucket
+    std::vector<unsigned> m_new_hits;   // hits since last flush
+    std::vector<char> m_dirty;          // counters changed since last flush
+    std::vector<int> m_touched;         // dirty buckets
+    std::vector<int> m_round_buckets;   // buckets with hits
+    unsigned m_round_npackets;
+    double m_big_sum;
 
-    void count_stats(const MeasurementBundle& mb);
-    std::vector<PktCount>& get_pkt_count_vec(int delay);
-    double compute_integral(int pkt_idx) const;
+    void count_stats(const PacketDelays& delays, Shard& shard) const;
+    void merge_shard(Shard& shard, bool round_packets);
+    Shard& get_shard(int idx);
+    void start_round();
+    void flush_buckets();
+    int get_bucket(int32_t delay) const;    // delay in microseconds
+    PktCount* get_pkt_counts(int bucket);   // grows table if needed
+    bool is_bucket_used(size_t bucket) const;
+    double compute_integral(size_t bucket) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef __PacketDelays__
+#define __PacketDelays__
+
+#include <algorithm>
+#include <stdint.h>
+#include <sys/time.h>
+#include <vector>
+
+// 1000 seconds, larger delays are treated as invalid
+#define MAX_PACKET_DELAY 1000000000
+
+
+/* Per-packet delays of one stream in columns: int32 microseconds (-1 - lost or invalid)
+ * and bitmap of lost packets. Storage is kept between streams.
+ */
+class PacketDelays{
+public:
+    void clear(){
+        m_delays.clear();
+        m_lost.clear();
+    }
+
+    void reserve(size_t n){
+        m_delays.reserve(n);
+        m_lost.reserve((n + 63) / 64);
+    }
+
+    // delay in microseconds, negative for lost packet
+    void push_back(int64_t delay){
+        size_t idx = m_delays.size();
+        if ((idx & 63) == 0){
+            m_lost.push_back(0);
+        }
+        if (delay < 0){
+            m_lost[idx >> 6] |= 1ULL << (idx & 63);
+            delay = -1;
+        } else if (delay > MAX_PACKET_DELAY){
+            delay = -1;
+        }
+        m_delays.push_back((int32_t)delay);
+    }
+
+    // timeval delays of MeasurementBundle, tv_sec == -1 marks lost packet
+    void assign(const std::vector<timeval>& delays_vec){
+        clear();
+        reserve(delays_vec.size());
+        for (const auto& tv: delays_vec){
+            if (tv.tv_sec == -1){
+                push_back(-1);
+            } else {
+                int64_t delay = tv.tv_sec * 1000000LL + tv.tv_usec;
+                push_back(delay < 0 ? MAX_PACKET_DELAY + 1 : delay);
+            }
+        }
+    }
+
+    size_t size() const { return m_delays.size(); };
+    const int32_t* delays() const { return m_delays.data(); };     // microseconds
+    bool is_lost(size_t idx) const { return (m_lost[idx >> 6] >> (idx & 63)) & 1; };
+    unsigned get_nlost() const { return count_lost(0, size()); };
+
+    // lost packets in [first, last), popcount over bitmap words
+    unsigned count_lost(size_t first, size_t last) const{
+        unsigned nlost = 0;
+        while (first < last && (first & 63) != 0){
+            nlost += is_lost(first++);
+        }
+        while (first + 64 <= last){
+            nlost += __builtin_popcountll(m_lost[first >> 6]);
+            first += 64;
+        }
+        while (first < last){
+            nlost += is_lost(first++);
+        }
+        return nlost;
+    }
+
+    // f(idx) for every lost packet in [first, last), 64 packets per bitmap word
+    template<typename F>
+    void for_each_lost(size_t first, size_t last, F f) const{
+        while (first < last){
+            size_t span = std::min<size_t>(64 - (first & 63), last - first);
+            uint64_t bits = m_lost[first >> 6] >> (first & 63);
+            if (span < 64){
+                bits &= (1ULL << span) - 1;
+            }
+            while (bits != 0){
+                f(first + __builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+            first += span;
+        }
+    }
+private:
+    std::vector<int32_t> m_delays;
+    std::vector<uint64_t> m_lost;
+};
+
+#endif
@@ -1,12 +1,23 @@
 #include "chest.h"
+#include "multi_chest.h"
 #include "abet/yaz/yaz.h"
+#include "util/clock.h"
+#include "util/phase_timer.h"
 #include <iostream>
+#include <climits>
+
+// seconds
+#define DEFAULT_BUDGET_WINDOW 10
+
+// limits of -j, -a and -C
+#define MAX_WORKERS 1024
+#define MAX_SESSIONS 1024
 
 void usage(const char *proggie)
 {
-    std::cerr << "usage: " << proggie << " <-R|-S <dest addr>>" << std::endl;
+    std::cerr << "usage: " << proggie << " <-R|-S <dest addr> [-S <dest addr> ...]>" << std::endl;
 
-    std::cerr << "   if sender (-S <destaddr>):" << std::endl;
+    std::cerr << "   if sender (-S <destaddr>, repeat for many receivers):" << std::endl;
     std::cerr << "      (default destination address: 127.0.0.1" << std::endl;
     std::cerr << "      -l <int>   minimum packet size (default: 200)" << std::endl;
 
@@ -20,12 +31,29 @@ void usage(const char *proggie)
 
     std::cerr << "      -o <filename> specify output file for ChEst estimation" << std::endl;
     std::cerr << "      -Y set ChEst output to yaml format" << std::endl;
+    std::cerr << "      -B set ChEst output to binary record stream (decode with chest_decode)" << std::endl;
+    std::cerr << "      -M <name>  publish latest round to /dev/shm/<name> (read with chest_shm_read)" << std::endl;
     std::cerr << "      -g <filename> specify file for ELR stats initialisazion" << std::endl;
     std::cerr << "      -e <filename> specify file to save ELR stats" << std::endl;
+    std::cerr << "      -W <int>   threads for ELR stats update of abw round (default: 1)" << std::endl;
+    std::cerr << "      -L <float> delay resolution of ELR stats (milliseconds; default: " << DEFAULT_DELAY_BUCKET / 1000. << ")" << std::endl;
+    std::cerr << "      -w <int>   number of pings in flight, single receiver only (default: 1)" << std::endl;
+    std::cerr << "      -k <int>   send pings in bursts of given length for loss estimation, single receiver only (default: off)" << std::endl;
+    std::cerr << "      -G <int>,<int> adapt gap between rounds to channel stability within min,max (milliseconds)" << std::endl;
+    std::cerr << "      -O <float>[,<int>] overhead budget of abw trains and pings: kbit/s averaged over seconds (default window: " << DEFAULT_BUDGET_WINDOW << ")" << std::endl;
+    std::cerr << "      -j <int>   worker threads for many receivers (default: one per receiver, up to cores)" << std::endl;
+    std::cerr << "      -a <int>   abw trains running at once for many receivers (default: " << DEFAULT_ABW_TRAINS << ")" << std::endl;
+
+    std::cerr << "   if receiver (-R):" << std::endl;
+    std::cerr << "      -C <int>   concurrent sender sessions, session i uses ports + i (default: 1)" << std::endl;
 
     std::cerr << "   for both sender and receiver:" << std::endl;
     std::cerr << "      -p <port>  specify control port (" << DEST_CTRL_PORT << ")" << std::endl;
     std::cerr << "      -P <port>  specify probe port (" << DEST_PORT << ")" << std::endl;
+    std::cerr << "      -A <int>   write results from background thread, flush every <int> milliseconds (min: 1)" << std::endl;
+    std::cerr << "      -D         drop results if background writer falls behind (default: wait)" << std::endl;
+    std::cerr << "      -t         use TSC clock if CPU has invariant TSC" << std::endl;
+    std::cerr << "      -I         time hot-path phases, shown in verbose yaml output and dumped on SIGUSR1" << std::endl;
     std::cerr << "      -v         increase verbosity" << std::endl;
     std::cerr << "      -b         decrease CPU utilization but also decrease yaz ABW estimation accuracy" << std::endl;
 //    std::cerr << "      -u         use round-robin scheduler for threads(?) *****" << std::endl;
@@ -40,6 +68,20 @@ bool is_root(){
 }
 
 
+// integer value of option within [min_value, max_value], exits otherwise
+int int_option(int opt, const char* arg, int min_value, int max_value){
+    char* end = NULL;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || value < min_value || value > max_value){
+        std::cerr << "Bad value of -" << (char)opt << ": '" << arg << "', expected integer in ["
+                  << min_value << ", " << max_value << "]" << std::endl;
+        exit (-1);
+    }
+    return (int)value;
+}
+
+
 int main(int argc, char **argv)
 {
     if (!is_root()){
@@ -52,7 +94,7 @@ int main(int argc, char **argv)
     unsigned short dest_control = DEST_CTRL_PORT;
     unsigned short dest_port = DEST_PORT;
 
-    std::string dstip = "127.0.0.1";
+    std::vector<std::string> dstips;
     bool sender = false;
     bool receiver = false;
     int min_pkt_size = 200;
@@ -73,8 +115,25 @@ int main(int argc, char **argv)
     std::string elr_stats_file_write;
     std::string chest_res_file;
     bool is_yaml_output = false;
+    int ping_window = 1;
+    int loss_burst_len = 0;
+    int delay_bucket = DEFAULT_DELAY_BUCKET;
+    int elr_threads = 1;
+    bool use_tsc = false;
+    bool phase_timers = false;
+    int n_workers = 0;
+    int abw_trains = DEFAULT_ABW_TRAINS;
+    int n_sessions = 1;
+    int flush_interval = -1;
+    bool drop_results = false;
+    bool is_binary_output = false;
+    std::string shm_name;
+    int min_gap = -1;
+    float budget_rate = -1;     // bits/sec
+    int budget_window = DEFAULT_BUDGET_WINDOW;
+    int max_gap = -1;
 
-    while ((c = getopt(argc, argv, "c:i:l:m:n:p:P:RS:r:s:x:yo:g:e:hvb")) != EOF)
+    while ((c = getopt(argc, argv, "c:i:l:m:n:p:P:RS:r:s:x:yo:g:e:w:k:j:a:C:A:DBM:G:O:L:W:hvbtI")) != EOF)
     {
         switch(c)
         {
@@ -107,7 +166,7 @@ int main(int argc, char **argv)
             sender = false;
             break;
         case 'S':
-            dstip = optarg;
+            dstips.push_back(optarg);
             receiver = false;
             sender = true;
             break;
@@ -132,6 +191,66 @@ int main(int argc, char **argv)
         case 'b':
             yaz_high_accuracy = false;
             break;
+        case 'w':
+            ping_window = int_option(c, optarg, 1, MAX_PING_WINDOW);
+            break;
+        case 'k':
+            loss_burst_len = int_option(c, optarg, 0, MAX_PING_WINDOW);
+            break;
+        case 'j':
+            n_workers = int_option(c, optarg, 0, MAX_WORKERS);
+            break;
+        case 'a':
+            abw_trains = int_option(c, optarg, 1, MAX_WORKERS);
+            break;
+        case 'C':
+            n_sessions = int_option(c, optarg, 1, MAX_SESSIONS);
+            break;
+        case 'O':
+            if (sscanf(optarg, "%f,%d", &budget_rate, &budget_window) < 1 || budget_rate <= 0 || budget_window <= 0){
+                usage(argv[0]);
+                exit (-1);
+            }
+            budget_rate *= 1000.0;  // input as kbps - conv to bps
+            break;
+        case 'G':
+            if (sscanf(optarg, "%d,%d", &min_gap, &max_gap) != 2 || min_gap <= 0 || max_gap < min_gap || max_gap > INT_MAX / 1000){
+                usage(argv[0]);
+                exit (-1);
+            }
+            min_gap *= 1000;    // input as millisec, internal as microsec
+            max_gap *= 1000;
+            break;
+        case 'L':{
+            float bucket_ms = atof(optarg);
+            if (bucket_ms <= 0){
+                usage(argv[0]);
+                exit (-1);
+            }
+            delay_bucket = bucket_ms * 1000;    // input as millisec, internal as microsec
+            break;
+        }
+        case 'W':
+            elr_threads = int_option(c, optarg, 1, MAX_WORKERS);
+            break;
+        case 'M':
+            shm_name = optarg;
+            break;
+        case 'B':
+            is_binary_output = true;
+            break;
+        case 'A':
+            flush_interval = int_option(c, optarg, MIN_WRITER_FLUSH_INTERVAL / 1000, INT_MAX / 1000) * 1000;  // input as millisec, internal as microsec
+            break;
+        case 'D':
+            drop_results = true;
+            break;
+        case 't':
+            use_tsc = true;
+            break;
+        case 'I':
+            phase_timers = true;
+            break;
         case 'h':
             usage(argv[0]);
             return 0;
@@ -141,8 +260,19 @@ int main(int argc, char **argv)
         }
     }
 
-    std::unique_ptr<ABSender> ab_sender;
-    std::unique_ptr<ABReceiver> ab_receiver;
+    if (use_tsc && !clock_use_tsc()){
+        std::cerr << "Invariant TSC is not available, using " << clock_source_name() << std::endl;
+    }
+#ifdef CHEST_PHASE_TIMERS
+    phase_timers_enable(phase_timers);
+#else
+    if (phase_timers){
+        std::cerr << "Phase timers are not compiled in, rebuild with CHEST_PHASE_TIMERS" << std::endl;
+    }
+#endif
+
+    std::function<std::unique_ptr<ABSender>(const std::string&)> make_ab_sender;
+    std::function<std::unique_ptr<ABReceiver>(int)> make_ab_receiver;
     std::unique_ptr<ChestEndPt> chest;
 
     if (sender)
@@ -150,41 +280,45 @@ int main(int argc, char **argv)
         if (verbose)
             std::cout << "## starting sender ##" << std::endl;
 
-        std::unique_ptr<YazSender> ys = std::make_unique<YazSender>();
+        make_ab_sender = [&](const std::string& dstip){
+            std::unique_ptr<YazSender> ys = std::make_unique<YazSender>();
 
-        ys->setMinPktSize(min_pkt_size);
-        ys->setStreamLength(stream_length);
-        ys->setStreams(n_streams);
-        ys->setInterStreamSpacing(inter_stream_spacing);
-        ys->setTarget(dstip.c_str());
-        ys->setResolution(resolution);
-        ys->setInitialSpacing(init_spacing);
-        ys->setInitialPktSize(init_pkt_size);
+            ys->setMinPktSize(min_pkt_size);
+            ys->setStreamLength(stream_length);
+            ys->setStreams(n_streams);
+            ys->setInterStreamSpacing(inter_stream_spacing);
+            ys->setTarget(dstip.c_str());
+            ys->setResolution(resolution);
+            ys->setInitialSpacing(init_spacing);
+            ys->setInitialPktSize(init_pkt_size);
 
-        ys->setCtrlDest(dest_control);
-        ys->setProbeDest(dest_port);
-        ys->setVerbosity(verbose);
-    #if HAVE_PCAP_H
-        ys->setPcapDev(pcap_dev);
-    #endif
+            ys->setCtrlDest(dest_control);
+            ys->setProbeDest(dest_port);
+            ys->setVerbosity(verbose);
+        #if HAVE_PCAP_H
+            ys->setPcapDev(pcap_dev);
+        #endif
 
-        ab_sender = std::move(ys);
+            return std::unique_ptr<ABSender>(std::move(ys));
+        };
     }
     else if (receiver)
     {
         if (verbose)
             std::cout << "## starting sender ##" << std::endl;
 
-        std::unique_ptr<YazReceiver> ys = std::make_unique<YazReceiver>();
-        ys->setCtrlDest(dest_control);
-        ys->setProbeDest(dest_port);
-        ys->setVerbosity(verbose);
-        ys->setAccuracy(yaz_high_accuracy);
-    #if HAVE_PCAP_H
-        ys->setPcapDev(pcap_dev);
-    #endif
+        make_ab_receiver = [&](int session){
+            std::unique_ptr<YazReceiver> ys = std::make_unique<YazReceiver>();
+            ys->setCtrlDest(dest_control + session);
+            ys->setProbeDest(dest_port + session);
+            ys->setVerbosity(verbose);
+            ys->setAccuracy(yaz_high_accuracy);
+        #if HAVE_PCAP_H
+            ys->setPcapDev(pcap_dev);
+        #endif
 
-        ab_receiver = std::move(ys);
+            return std::unique_ptr<ABReceiver>(std::move(ys));
+        };
     }
     else
     {
@@ -192,27 +326,106 @@ int main(int argc, char **argv)
         return (0);
     }
 
-    if (sender){
-        Pinger pinger(dstip.c_str());
-        LossElr losser;
+    std::shared_ptr<TokenBucket> budget;    // one budget for all receivers
+    if (budget_rate > 0){
+        budget = std::make_shared<TokenBucket>(budget_rate, budget_rate * budget_window);
+    }
+
+    std::shared_ptr<TaskPool> elr_pool;     // shared by all receivers, one round at a time
+    if (elr_threads > 1){
+        elr_pool = std::make_shared<TaskPool>(elr_threads - 1);
+    }
+
+    // many receivers share pinger of MultiChestSender
+    bool shared_pinger = dstips.size() > 1;
+    if (shared_pinger && (ping_window > 1 || loss_burst_len > 0)){
+        std::cerr << "-w and -k need single receiver" << std::endl;
+        exit (-1);
+    }
+
+    auto make_chest_sender = [&](const std::string& dstip){
+        std::unique_ptr<ABSender> ab_sender = make_ab_sender(dstip);
+        std::unique_ptr<Pinger> pinger;     // empty with shared pinger
+        if (!shared_pinger){
+            if (ping_window > 1){
+                pinger = std::make_unique<PipelinedPinger>(dstip.c_str(), ping_window);
+            } else {
+                pinger = std::make_unique<Pinger>(dstip.c_str());
+            }
+        }
+        LossElr losser(ELR_CONSISTENCY_THRESHOLD, TAU_NSTEPS, delay_bucket);
         if (elr_stats_file_read.length() != 0){
             losser.deserialize_from_file(elr_stats_file_read);  // fill pre-collected stats
+            if (losser.get_delay_bucket() != delay_bucket){
+                std::cerr << "Using delay resolution of ELR stats file: " << losser.get_delay_bucket() << " us" << std::endl;
+            }
+        }
+        if (elr_threads > 1){
+            losser.set_workers(elr_pool);   // calling thread counts too
+        }
+        auto chest_sender = pinger ? std::make_unique<ChestSender>(ab_sender, *pinger, losser)
+                                   : std::make_unique<ChestSender>(ab_sender, losser);
+        chest_sender->set_loss_burst(loss_burst_len);
+        if (min_gap > 0){
+            chest_sender->set_adaptive_gap(min_gap, max_gap);
+        }
+        if (budget){
+            chest_sender->set_overhead_budget(budget);
+        }
+        return chest_sender;
+    };
+
+    if (sender && dstips.size() == 1){
+        auto chest_sender = make_chest_sender(dstips[0]);
+        if (shm_name.length() != 0){
+            chest_sender->set_shm_export(shm_name);
         }
-        chest = std::make_unique<ChestSender>(ab_sender, pinger, losser);
+        chest = std::move(chest_sender);
+    } else if (sender){
+        auto multi_sender = std::make_unique<MultiChestSender>(n_workers, abw_trains);
+        multi_sender->set_shm_export(shm_name);
+        for (const auto& dstip: dstips){
+            multi_sender->add_peer(make_chest_sender(dstip), dstip);
+        }
+        chest = std::move(multi_sender);
     } else {
-        chest = std::make_unique<ChestReceiver>(ab_receiver);
+        std::unique_ptr<ABReceiver> ab_receiver = make_ab_receiver(0);
+        auto chest_receiver = std::make_unique<ChestReceiver>(ab_receiver);
+        for (int i = 1; i < n_sessions; i++){
+            ab_receiver = make_ab_receiver(i);
+            chest_receiver->add_session(ab_receiver);
+        }
+        chest = std::move(chest_receiver);
     }
 
     chest->set_verbosity(verbose);
     chest->set_output_format(is_yaml_output);
+    chest->set_binary_output(is_binary_output);
     if (chest_res_file.length() != 0){
         chest->set_output_file(chest_res_file);
     }
+    if (flush_interval >= 0){
+        chest->set_async_output(flush_interval, drop_results);
+    }
 
-    chest->run();
-    if (sender && elr_stats_file_write.length() != 0){;
-        std::cerr << "Serializing ELR stats" << std::endl;  // not always reached when supposed...
-        dynamic_cast<ChestSender*>(chest.get())->get_losser()->serialize_to_file(elr_stats_file_write);
+    try{
+        chest->run();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    // SIGINT ends run() at once, collected stats are kept anyway
+    if (sender && elr_stats_file_write.length() != 0){
+        std::cerr << "Serializing ELR stats" << std::endl;
+        if (dstips.size() == 1){
+            dynamic_cast<ChestSender*>(chest.get())->get_losser()->serialize_to_file(elr_stats_file_write);
+        } else {
+            // one file per receiver: <filename>.<dest addr>
+            MultiChestSender* multi_sender = dynamic_cast<MultiChestSender*>(chest.get());
+            for (size_t i = 0; i < multi_sender->get_peers_count(); i++){
+                multi_sender->get_peer(i)->get_losser()->serialize_to_file(
+                    elr_stats_file_write + "." + multi_sender->get_peer_tag(i));
+            }
+        }
     }
     google::protobuf::ShutdownProtobufLibrary();
     std::cerr << "ChEst exitting!" << std::endl;
@@ -0,0 +1,247 @@
+#include "multi_chest.h"
+#include "util/clock.h"
+#include "util/phase_timer.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <thread>
+
+
+MultiChestSender::MultiChestSender(int nworkers, int max_abw_trains, int ping_gap):
+m_nworkers(nworkers), m_abw_limit(max_abw_trains < 1 ? 1 : max_abw_trains), m_pinger(ping_gap),
+m_nqueued(0), m_stopped(false)
+{}
+
+
+int MultiChestSender::add_peer(std::unique_ptr<ChestSender> sender, const std::string& host){
+    int target = m_pinger.add_target(host.c_str());     // own ICMP id, replies of peers don't mix
+    sender->set_peer_tag(host);
+    sender->set_ping_source(&m_pinger, target);
+    sender->set_abw_limit(&m_abw_limit);
+    m_peers.push_back(Peer{std::move(sender), host, 0, true});
+    return m_peers.size() - 1;
+}
+
+
+void MultiChestSender::set_shm_export(const std::string& name){
+    m_shm_name = name;
+}
+
+
+size_t MultiChestSender::get_peers_count() const{
+    return m_peers.size();
+}
+
+
+const ChestSender* MultiChestSender::get_peer(int peer) const{
+    return m_peers[peer].sender.get();
+}
+
+
+std::string MultiChestSender::get_peer_tag(int peer) const{
+    return m_peers[peer].tag;
+}
+
+
+// peers failed to setup are not measured
+void MultiChestSender::setup_peers(){
+    for (auto& peer: m_peers){
+        peer.sender->set_verbosity(m_verbose);
+        peer.sender->set_output_format(m_yaml_output);
+        peer.sender->set_binary_output(m_binary_output);
+        try{
+            if (!m_shm_name.empty()){
+                peer.sender->set_shm_export(m_shm_name + "." + peer.tag);
+            }
+            peer.sender->setup();
+        } catch (std::exception& e){
+            std::cerr << '[' << peer.tag << "] " << e.what() << std::endl;
+            peer.active = false;
+        }
+    }
+}
+
+
+void MultiChestSender::push_task(int peer){
+    WorkQueue& queue = *m_queues[peer % m_queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks.push_back(peer);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_nqueued += 1;
+    }
+    m_work_cv.notify_one();
+}
+
+
+// own queue first, then steal from the others
+bool MultiChestSender::take_task(int idx, int& peer){
+    for (size_t i = 0; i < m_queues.size(); i++){
+        WorkQueue& queue = *m_queues[(idx + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.tasks.empty()){
+            continue;
+        }
+        if (i == 0){
+            peer = queue.tasks.front();
+            queue.tasks.pop_front();
+        } else {
+            peer = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        m_nqueued -= 1;
+        return true;
+    }
+    return false;
+}
+
+
+void MultiChestSender::run_peer_round(int peer_idx){
+    Peer& peer = m_peers[peer_idx];
+    int64_t start = timer_clock_us();
+    try{
+        peer.sender->run_round(peer.runnum);
+        std::ostringstream record;
+        peer.sender->print_snapshot(peer.sender->get_snapshot(), record);
+        std::lock_guard<std::mutex> lock(m_output_lock);   // writer queue has single producer
+        write_record(record.str());
+        if (take_phase_dump_request()){
+            print_phase_timers(std::cerr);
+        }
+    } catch (std::exception& e) {
+        std::lock_guard<std::mutex> lock(m_output_lock);
+        std::cerr << '[' << peer.tag << "] " << e.what() << std::endl;
+        peer.active = false;
+    }
+    peer.runnum += 1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_finished.emplace_back(peer_idx, start);
+    }
+    m_round_done.notify();
+}
+
+
+void MultiChestSender::worker(int idx){
+    while (!m_stopped){
+        int peer;
+        if (take_task(idx, peer)){
+            run_peer_round(peer);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_work_cv.wait(lock, [this](){ return m_stopped || m_nqueued > 0; });
+    }
+}
+
+
+// releases every peer measurment gap after start of its previous round
+void MultiChestSender::schedule(SignalFd& signals){
+    using Release = std::pair<int64_t, int>;    // time (timer clock, microseconds), peer
+    std::priority_queue<Release, std::vector<Release>, std::greater<Release>> releases;
+    int nrunning = 0;
+    for (size_t i = 0; i < m_peers.size(); i++){
+        if (m_peers[i].active){
+            push_task(i);
+            nrunning += 1;
+        }
+    }
+
+    // callbacks only wake loop, state is updated below
+    EventLoop loop;
+    TimerFd release_timer;
+    bool stopped = false;
+    loop.add_fd(signals.get_fd(), [&](){
+        int signo;
+        while ((signo = signals.consume()) != 0){
+            if (signo == SIGINT){
+                stopped = true;
+            } else {
+                request_phase_dump(signo);  // dump phase timers on demand
+            }
+        }
+        loop.stop();
+    });
+    loop.add_fd(m_round_done.get_fd(), [&](){
+        m_round_done.consume();
+        loop.stop();
+    });
+    loop.add_fd(release_timer.get_fd(), [&](){
+        release_timer.consume();
+        loop.stop();
+    });
+
+    std::vector<std::pair<int, int64_t>> finished;
+    while (!stopped && (nrunning > 0 || !releases.empty())){
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            finished.swap(m_finished);
+        }
+        for (const auto& elem: finished){
+            nrunning -= 1;
+            const Peer& peer = m_peers[elem.first];
+            if (peer.active){
+                int64_t release = std::max(elem.second + peer.sender->get_measurment_gap(),
+                                           timer_clock_us() + peer.sender->get_budget_delay());
+                releases.emplace(release, elem.first);
+            }
+        }
+        finished.clear();
+
+        int64_t now = timer_clock_us();
+        while (!releases.empty() && releases.top().first <= now){
+            push_task(releases.top().second);
+            releases.pop();
+            nrunning += 1;
+        }
+        if (nrunning == 0 && releases.empty()){
+            break;
+        }
+        if (!releases.empty()){
+            release_timer.arm_at(releases.top().first * 1000);
+        } else {
+            release_timer.disarm();
+        }
+        loop.run();
+    }
+}
+
+
+void MultiChestSender::run(){
+    SignalFd signals({SIGINT, SIGUSR1});    // before threads, so they inherit blocked mask
+    setup_peers();
+    int nworkers = m_nworkers;
+    if (nworkers <= 0){
+        nworkers = std::min<int>(m_peers.size(), std::max(1u, std::thread::hardware_concurrency()));
+    }
+    m_queues.clear();
+    for (int i = 0; i < nworkers; i++){
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+    m_stopped = false;
+
+    m_pinger.set_keep_results(true);
+    std::thread pinger_thread([this](){ m_pinger.run(); });
+    std::vector<std::thread> workers;
+    for (int i = 0; i < nworkers; i++){
+        workers.emplace_back(&MultiChestSender::worker, this, i);
+    }
+    schedule(signals);
+
+    // rounds already started are finished
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopped = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread: workers){
+        thread.join();
+    }
+    m_pinger.stop();
+    pinger_thread.join();
+    finish_output();
+}
@@ -0,0 +1,71 @@
+#ifndef __MultiChEst__
+#define __MultiChEst__
+
+#include "chest.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// concurrent abw trains of all peers
+#define DEFAULT_ABW_TRAINS 1
+
+
+/* Tracks channel state toward many receivers from one process.
+ * Every peer is a ChestSender with own estimators; its rounds are tasks for a fixed
+ * pool of workers. Scheduler (caller thread, epoll loop) releases a peer after its
+ * measurement gap to the queue of its home worker, idle workers steal from queues of others.
+ * All peers are pinged by one MultiPinger (one raw socket, own thread), so every reply
+ * is parsed once; rounds take pings of their peer from it.
+ */
+class MultiChestSender: public ChestEndPt{
+public:
+    // 0 workers - one per peer, up to cores; ping_gap between probes to one peer, microseconds
+    explicit MultiChestSender(int nworkers=0, int max_abw_trains=DEFAULT_ABW_TRAINS, int ping_gap=DEFAULT_MEASURMENT_GAP);
+    MultiChestSender(const MultiChestSender& other) = delete;
+    MultiChestSender& operator=(const MultiChestSender& other) = delete;
+
+    // sender without Pinger, host is pinged and tags output of peer; returns peer index
+    int add_peer(std::unique_ptr<ChestSender> sender, const std::string& host);
+    virtual void run() override;    // until SIGINT
+    void set_shm_export(const std::string& name);   // every peer to /dev/shm/<name>.<tag>
+    size_t get_peers_count() const;
+    const ChestSender* get_peer(int peer) const;
+    std::string get_peer_tag(int peer) const;
+private:
+    struct Peer{
+        std::unique_ptr<ChestSender> sender;
+        std::string tag;
+        int runnum;
+        bool active;
+    };
+    struct WorkQueue{
+        std::mutex lock;
+        std::deque<int> tasks;  // peer indices, owner pops front, thieves take back
+    };
+    int m_nworkers;
+    Semaphore m_abw_limit;
+    std::vector<Peer> m_peers;
+    std::string m_shm_name;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    MultiPinger m_pinger;
+
+    std::mutex m_lock;                  // protects m_finished and wait below
+    std::condition_variable m_work_cv;  // idle workers
+    std::vector<std::pair<int, int64_t>> m_finished;    // peer, start of its round (timer clock, microseconds)
+    EventFd m_round_done;               // wakes scheduler
+    std::atomic<int> m_nqueued;
+    std::atomic<bool> m_stopped;
+    std::mutex m_output_lock;
+
+    void setup_peers();
+    void schedule(SignalFd& signals);
+    void worker(int idx);
+    bool take_task(int idx, int& peer);
+    void push_task(int peer);
+    void run_peer_round(int peer);
+};
+
+#endif
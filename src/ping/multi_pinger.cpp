@@ -0,0 +1,345 @@
+#include "multi_pinger.h"
+#include "../util/clock.h"
+#include <stdexcept>
+#include <algorithm>
+
+/////////////////// TimerWheel
+TimerWheel::TimerWheel(int _tick, int nslots):
+tick(_tick * 1000LL), curr_time(0), curr_slot(0), ntimers(0), slots(nslots < 1 ? 1 : nslots),
+occupied((slots.size() + 63) / 64, 0) {};
+
+void TimerWheel::reset(int64_t now){
+    for (auto& slot: slots){
+        slot.clear();
+    }
+    std::fill(occupied.begin(), occupied.end(), 0);
+    curr_time = now;
+    curr_slot = 0;
+    ntimers = 0;
+}
+
+
+void TimerWheel::schedule(const Timer& timer){
+    int64_t ticks = (timer.deadline - curr_time) / tick;
+    if (ticks < 0){
+        ticks = 0;
+    }
+    size_t slot = (curr_slot + ticks) % slots.size();
+    slots[slot].push_back(timer);
+    occupied[slot / 64] |= 1ULL << (slot % 64);
+    ntimers += 1;
+}
+
+
+// move timers with deadline before limit to due, keep others in slot
+void TimerWheel::take_due(size_t slot, int64_t limit, std::vector<Timer>& due){
+    pending.clear();
+    for (const auto& timer: slots[slot]){
+        if (timer.deadline < limit){
+            due.push_back(timer);
+        } else {
+            pending.push_back(timer);
+        }
+    }
+    ntimers -= slots[slot].size() - pending.size();
+    slots[slot].swap(pending);
+    if (slots[slot].empty()){
+        occupied[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+}
+
+
+void TimerWheel::advance(int64_t now, std::vector<Timer>& due){
+    while (curr_time + tick <= now){
+        if (!slots[curr_slot].empty()){
+            take_due(curr_slot, curr_time + tick, due);
+        }
+        curr_time += tick;
+        curr_slot = (curr_slot + 1) % slots.size();
+    }
+    if (!slots[curr_slot].empty()){
+        take_due(curr_slot, now + 1, due);
+    }
+}
+
+
+// first occupied slot in [from, to), to if none
+size_t TimerWheel::find_occupied(size_t from, size_t to) const{
+    while (from < to){
+        uint64_t word = occupied[from / 64] >> (from % 64);
+        if (word){
+            return std::min(to, from + __builtin_ctzll(word));
+        }
+        from += 64 - from % 64;
+    }
+    return to;
+}
+
+
+// earliest timer of current slot or start of next occupied slot, idle wheel doesn't tick
+int64_t TimerWheel::next_deadline() const{
+    if (ntimers == 0){
+        return INT64_MAX;
+    }
+    int64_t deadline = INT64_MAX;
+    for (const auto& timer: slots[curr_slot]){
+        deadline = std::min(deadline, timer.deadline);
+    }
+    size_t next = find_occupied(curr_slot + 1, slots.size());
+    size_t distance = next - curr_slot;
+    if (next == slots.size()){
+        next = find_occupied(0, curr_slot);
+        distance = next + slots.size() - curr_slot;
+        if (next == curr_slot){
+            return deadline;
+        }
+    }
+    return std::min(deadline, curr_time + (int64_t)distance * tick);
+}
+
+
+/////////////////// MultiPinger
+namespace multi_ping_handler{
+    volatile sig_atomic_t ping_stopped = 0;
+
+    void stop_ping(int signo){
+        ping_stopped = 1;
+    }
+}
+
+
+MultiPinger::MultiPinger(int _ping_gap, int _ping_timeout):
+ping_gap(_ping_gap), ping_timeout(_ping_timeout), base_id((uint16_t)(getpid() + 1)),
+stopped(false), keep_results(false)
+{
+    if (ping_gap <= 0){
+        throw std::runtime_error("Ping gap must be positive");
+    }
+    // slot is reused only after probe in it has expired (or 65536 gaps later)
+    int nslots = 1;
+    while (nslots * (int64_t)ping_gap <= ping_timeout && nslots < MAX_PING_SLOTS){
+        nslots <<= 1;
+    }
+    slot_mask = nslots - 1;
+}
+
+
+int MultiPinger::add_target(const char* hostname){
+    if (targets.size() > 0xffff){
+        throw std::runtime_error("Too many targets for 16-bit ICMP id space");
+    }
+    struct addrinfo* addrinfo_list;
+    resolve_addr(hostname, &addrinfo_list);
+    Target target;
+    target.hostname = hostname;
+    memcpy(&target.addr, addrinfo_list->ai_addr, addrinfo_list->ai_addrlen);
+    target.addr_len = (socklen_t)addrinfo_list->ai_addrlen;
+    clear_addrinfo(addrinfo_list);
+
+    target.id = (uint16_t)(base_id + targets.size());
+    target.next_seq = 0;
+    target.slots.resize(slot_mask + 1);
+    for (auto& slot: target.slots){
+        slot.seq = -1;
+        slot.outstanding = false;
+    }
+    targets.push_back(std::move(target));
+    return targets.size() - 1;
+}
+
+
+size_t MultiPinger::get_targets_count() const{
+    return targets.size();
+}
+
+
+std::string MultiPinger::get_hostname(int target) const{
+    return targets[target].hostname;
+}
+
+
+const PingStat& MultiPinger::get_stats(int target) const{
+    return targets[target].stats;
+}
+
+
+void MultiPinger::set_keep_results(bool keep){
+    keep_results = keep;
+}
+
+
+void MultiPinger::take_results(int target, std::vector<ProbeResult>& results){
+    std::lock_guard<std::mutex> lock(results_lock);
+    std::vector<ProbeResult>& kept = targets[target].results;
+    results.insert(results.end(), kept.begin(), kept.end());
+    kept.clear();
+}
+
+
+void MultiPinger::record_result(Target& target, const PingRes& res, int seq){
+    target.stats.process_ping_res(res, seq, false);
+    if (keep_results){
+        std::lock_guard<std::mutex> lock(results_lock);
+        if (target.results.size() < MULTI_PING_MAX_RESULTS){
+            target.results.push_back(ProbeResult{seq, res});
+        }
+    }
+}
+
+
+void MultiPinger::stop(){
+    stopped = true;
+    wakeup.notify();
+}
+
+
+// spread first probes over one gap to avoid bursts
+void MultiPinger::schedule_targets(int64_t now){
+    wheel.reset(now);
+    for (size_t i = 0; i < targets.size(); i++){
+        int64_t offset = ping_gap * 1000LL * i / targets.size();
+        wheel.schedule(TimerWheel::Timer{now + offset, (int)i, -1});
+    }
+}
+
+
+void MultiPinger::send_probe(int target_idx, int64_t deadline){
+    Target& target = targets[target_idx];
+    int seq = target.next_seq;
+    target.next_seq = (target.next_seq + 1) & 0xffff;
+    ProbeSlot& slot = target.slots[seq & slot_mask];
+    if (slot.outstanding){
+        record_result(target, PingRes(-1), slot.seq);
+    }
+    slot.seq = seq;
+    try{
+        slot.sent = sock.send_echo(target.addr, target.addr_len, seq, target.id);
+        slot.outstanding = true;
+        wheel.schedule(TimerWheel::Timer{timer_clock_ns() + ping_timeout * 1000LL, target_idx, seq});
+    } catch (std::runtime_error& e){
+        slot.outstanding = false;
+        record_result(target, PingRes(-1), seq);
+    }
+    // fixed grid: next probe doesn't depend on processing time
+    wheel.schedule(TimerWheel::Timer{deadline + ping_gap * 1000LL, target_idx, -1});
+}
+
+
+void MultiPinger::expire_probe(int target_idx, int seq){
+    Target& target = targets[target_idx];
+    ProbeSlot& slot = target.slots[seq & slot_mask];
+    if (!slot.outstanding || slot.seq != seq){
+        return;     // already answered
+    }
+    slot.outstanding = false;
+    record_result(target, PingRes(-1), seq);
+}
+
+
+int MultiPinger::find_target(const EchoReply& reply) const{
+    size_t idx = (uint16_t)(reply.id - base_id);
+    if (idx >= targets.size()){
+        return -1;
+    }
+    const struct sockaddr_in* dst = (const struct sockaddr_in*)&targets[idx].addr;
+    if (dst->sin_addr.s_addr != reply.src.sin_addr.s_addr){
+        return -1;
+    }
+    return idx;
+}
+
+
+void MultiPinger::process_reply(const EchoReply& reply){
+    int target_idx = find_target(reply);
+    if (target_idx < 0){
+        return;
+    }
+    Target& target = targets[target_idx];
+    ProbeSlot& slot = target.slots[reply.seq & slot_mask];
+    if (!slot.outstanding || slot.seq != reply.seq){
+        return;     // duplicate or late reply
+    }
+    slot.outstanding = false;
+    PingRes res = PingRes::from_ns(sock.compute_rtt_ns(slot.sent, reply), reply.bad_checksum);
+    record_result(target, res, reply.seq);
+}
+
+
+// SIGINT interrupts ppoll, so signal handler flag is seen at once
+void MultiPinger::wait_events(int64_t timeout){
+    struct pollfd fds[2] = {{ sock.get_fd(), POLLIN, 0 }, { wakeup.get_fd(), POLLIN, 0 }};
+    struct timespec ts = { (time_t)(timeout / 1000000000), (long)(timeout % 1000000000) };
+    if (ppoll(fds, 2, timeout == INT64_MAX ? NULL : &ts, NULL) < 0 && errno != EINTR){
+        perror("ppoll");
+    }
+    if (fds[1].revents & POLLIN){
+        wakeup.consume();
+    }
+}
+
+
+// wheel runs on timer clock, so TSC doesn't drift probe grid
+void MultiPinger::run_until(int64_t end_time){
+    int64_t now = timer_clock_ns();
+    schedule_targets(now);
+    // every target has up to one probe per slot in flight
+    sock.reserve_tx_stamps(targets.size() * (slot_mask + 1));
+    while (!multi_ping_handler::ping_stopped && !stopped && now < end_time){
+        wheel.advance(now, due);
+        for (const auto& timer: due){
+            if (timer.seq == -1){
+                send_probe(timer.target, timer.deadline);
+            } else {
+                expire_probe(timer.target, timer.seq);
+            }
+        }
+        due.clear();
+
+        EchoReply reply;
+        int error;
+        while ((error = sock.recv_echo_reply(reply)) > 0){
+            process_reply(reply);
+        }
+        if (error < 0){
+            perror("recvmsg");
+            break;
+        }
+
+        now = timer_clock_ns();
+        int64_t deadline = std::min(wheel.next_deadline(), end_time);
+        if (deadline > now){
+            wait_events(deadline == INT64_MAX ? INT64_MAX : deadline - now);
+        }
+        now = timer_clock_ns();
+    }
+    stopped = false;
+}
+
+
+void MultiPinger::run_for(int duration){
+    multi_ping_handler::ping_stopped = 0;
+    run_until(timer_clock_ns() + duration * 1000LL);
+}
+
+
+void MultiPinger::run(){
+    multi_ping_handler::ping_stopped = 0;
+    run_until(INT64_MAX);
+}
+
+
+void MultiPinger::ping_continuously(){
+    multi_ping_handler::ping_stopped = 0;
+    auto prev_handler = signal(SIGINT, multi_ping_handler::stop_ping);  // break from loop after sigint
+    run_until(INT64_MAX);
+    print_statistics();
+    signal(SIGINT, prev_handler);   // return default handler
+}
+
+
+void MultiPinger::print_statistics() const{
+    for (const auto& target: targets){
+        fprintf(stdout, "%s:\n", target.hostname.c_str());
+        target.stats.print_statistics();
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef __MultiPinger__
+#define __MultiPinger__
+
+#include "pinger.h"
+#include "../util/event_loop.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// microseconds
+#define DEFAULT_WHEEL_TICK 1000
+
+#define DEFAULT_WHEEL_SLOTS 1024
+
+// results per target waiting for take_results()
+#define MULTI_PING_MAX_RESULTS 4096
+
+
+/* Hashed timing wheel: scheduling is O(1), advancing costs O(timers in passed slots).
+ * Timers further than one revolution stay in their slot until their round comes.
+ */
+class TimerWheel{
+public:
+    struct Timer{
+        int64_t deadline;   // timer clock, nanoseconds
+        int target;
+        int seq;            // -1 for send timer, probe seq for expiration timer
+    };
+    explicit TimerWheel(int _tick=DEFAULT_WHEEL_TICK, int nslots=DEFAULT_WHEEL_SLOTS);
+    void reset(int64_t now);
+    void schedule(const Timer& timer);
+    void advance(int64_t now, std::vector<Timer>& due);     // appends due timers
+    int64_t next_deadline() const;  // nanoseconds, when advance() may find due timers, INT64_MAX if empty
+private:
+    int64_t tick;       // nanoseconds
+    int64_t curr_time;  // start of current slot, nanoseconds
+    size_t curr_slot;
+    size_t ntimers;
+    std::vector<std::vector<Timer>> slots;
+    std::vector<uint64_t> occupied; // bit per non-empty slot
+    std::vector<Timer> pending;     // reused while filtering slot
+    void take_due(size_t slot, int64_t limit, std::vector<Timer>& due);
+    size_t find_occupied(size_t from, size_t to) const;
+};
+
+
+/* Pings many destinations over one shared raw socket.
+ * Every target gets own ICMP id, so replies are demultiplexed in O(1)
+ * by id, then checked against source address and matched by sequence number.
+ * Results may also be collected by other threads with take_results() while it runs.
+ */
+class MultiPinger{
+public:
+    struct ProbeResult{
+        int seq;
+        PingRes res;
+    };
+    explicit MultiPinger(int _ping_gap=DEFAULT_PING_GAP, int _ping_timeout=DEFAULT_PING_TIMEOUT);
+    MultiPinger(const MultiPinger& other) = delete;
+    MultiPinger& operator=(const MultiPinger& other) = delete;
+
+    int add_target(const char* hostname);   // returns target index
+    void ping_continuously();               // until SIGINT or stop()
+    void run();                             // until stop(), SIGINT is left to caller
+    void run_for(int duration);             // microseconds
+    void stop();                            // thread-safe, ends current (or next) run
+    void set_keep_results(bool keep=true);  // newest results over MULTI_PING_MAX_RESULTS are dropped
+    void take_results(int target, std::vector<ProbeResult>& results);  // thread-safe, appends results since last call
+    size_t get_targets_count() const;
+    std::string get_hostname(int target) const;
+    const PingStat& get_stats(int target) const;    // not while running
+    void print_statistics() const;
+private:
+    struct ProbeSlot{
+        int seq;
+        ProbeSendInfo sent;
+        bool outstanding;
+    };
+    struct Target{
+        std::string hostname;
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        uint16_t id;
+        int next_seq;
+        std::vector<ProbeSlot> slots;
+        PingStat stats;
+        std::vector<ProbeResult> results;   // guarded by results_lock
+    };
+    int ping_gap;       // microseconds
+    int ping_timeout;   // microseconds
+    uint16_t base_id;
+    unsigned slot_mask;
+    IcmpSocket sock;
+    std::vector<Target> targets;
+    TimerWheel wheel;
+    std::vector<TimerWheel::Timer> due;
+    std::atomic<bool> stopped;
+    EventFd wakeup;
+    bool keep_results;
+    std::mutex results_lock;
+
+    void run_until(int64_t end_time);
+    void wait_events(int64_t timeout);  // nanoseconds, until reply, stop() or timeout
+    void record_result(Target& target, const PingRes& res, int seq);
+    void schedule_targets(int64_t now);
+    void send_probe(int target, int64_t deadline);
+    void expire_probe(int target, int seq);
+    void process_reply(const EchoReply& reply);
+    int find_target(const EchoReply& reply) const;
+};
+
+#endif
@@ -1,8 +1,9 @@
 #include "pinger.h"
+#include "../util/checksum.h"
+#include "../util/clock.h"
+#include "../util/phase_timer.h"
 #include <stdexcept>
-
-void resolve_addr(const char* hostname, struct addrinfo** addrinfo_list);
-
+#include <algorithm>
 
 void clear_addrinfo(struct addrinfo* addrinfo_list){
     if (addrinfo_list != NULL) {
@@ -11,79 +12,44 @@ void clear_addrinfo(struct addrinfo* addrinfo_list){
 }
 
 
-/**
- * Returns a timestamp with microsecond resolution.
- */
-static uint64_t utime(void) {
-    struct timeval now;
-    return gettimeofday(&now, NULL) != 0
-        ? 0
-        : now.tv_sec * 1000000 + now.tv_usec;
-
+static int64_t timespec_to_ns(const struct timespec& ts){
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
 
-static uint16_t compute_checksum(const char *buf, size_t size) {
-    /* RFC 1071 - http://tools.ietf.org/html/rfc1071 */
-
-    size_t i;
-    uint64_t sum = 0;
-
-    for (i = 0; i < size; i += 2) {
-        sum += *(uint16_t *)buf;
-        buf += 2;
+/**
+ * Blocks until socket is readable or timeout (microseconds) expires.
+ * Returns ppoll() result: >0 readable, 0 timeout, <0 error.
+ */
+int IcmpSocket::wait_readable(int timeout){
+    struct pollfd pfd = { sockfd, POLLIN, 0 };
+    struct timespec ts = { timeout / 1000000, (timeout % 1000000) * 1000 };
+    int res = ppoll(&pfd, 1, &ts, NULL);
+    if (res < 0 && errno == EINTR){
+        return 0;   // let caller recheck deadline
     }
-    if (size - i > 0)
-        sum += *(uint8_t *)buf;
-
-    while ((sum >> 16) != 0)
-        sum = (sum & 0xffff) + (sum >> 16);
-
-    return (uint16_t)~sum;
+    return res;
 }
 
 
 Pinger::Pinger(const char* _hostname, int _ping_timeout): 
-    hostname(_hostname), ping_timeout(_ping_timeout)
+    hostname(_hostname), ping_timeout(_ping_timeout), n_duplicates(0), n_reordered(0), slot_mask(0)
 {
+    series.active = false;
+    series.outstanding = 0;
     struct addrinfo* addrinfo_list;
     resolve_addr(_hostname, &addrinfo_list);
-    make_socket(addrinfo_list);
+    set_addr(addrinfo_list);     // use first address
     clear_addrinfo(addrinfo_list);
     print_host();
 }
 
 
-Pinger::Pinger(Pinger&& other){
-    hostname = std::move(other.hostname);
-    ping_timeout = std::move(other.ping_timeout);
-    sockfd = other.sockfd;
-    other.sockfd = 0;
-    addr = std::move(other.addr);    
-    dst_addr_len = std::move(other.dst_addr_len);
-}
-
-Pinger& Pinger::operator=(Pinger&& other){
-    hostname = std::move(other.hostname);
-    ping_timeout = std::move(other.ping_timeout);
-    sockfd = other.sockfd;
-    other.sockfd = 0;
-    addr = std::move(other.addr);    
-    dst_addr_len = std::move(other.dst_addr_len);
-    return *this;
-}
-
-
 std::string Pinger::get_hostname() const{
     return hostname;
 }
 
 
-Pinger::~Pinger(){
-    close(sockfd);
-}
-
-
 void resolve_addr(const char* hostname, struct addrinfo** addrinfo_list){
     int error;
     struct addrinfo hints = {0};
@@ -102,29 +68,147 @@ void resolve_addr(const char* hostname, struct addrinfo** addrinfo_list){
 };
 
 
-// use first succesful address for socket and fill address field
-void Pinger::make_socket(struct addrinfo* addrinfo_list){
-    struct addrinfo* addrinfo;
-    for (addrinfo = addrinfo_list; addrinfo != NULL; addrinfo = addrinfo->ai_next) {
-        sockfd = socket(addrinfo->ai_family,
-                        addrinfo->ai_socktype,
-                        addrinfo->ai_protocol);
-        if (sockfd >= 0) {  // use first succesfull addr
-            break;
+IcmpSocket::IcmpSocket(){
+    sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+    if (sockfd < 0) {
+        throw std::runtime_error(std::string("Failed to create socket: ") + strerror(errno));
+    }
+    // non-blocking: recvmsg never blocks, waiting for reply is done in ppoll
+    if (fcntl(sockfd, F_SETFL, O_NONBLOCK) == -1) {
+        close(sockfd);
+        throw std::runtime_error("Failed to make socket non-blocking");
+    }
+    enable_timestamps();
+}
+
+
+IcmpSocket::IcmpSocket(IcmpSocket&& other):
+sockfd(other.sockfd), ts_mode(other.ts_mode), tx_counter(other.tx_counter),
+tx_stamps(std::move(other.tx_stamps))
+{
+    other.sockfd = -1;
+}
+
+
+IcmpSocket& IcmpSocket::operator=(IcmpSocket&& other){
+    if (this != &other){
+        if (sockfd >= 0){
+            close(sockfd);
         }
+        sockfd = other.sockfd;
+        other.sockfd = -1;
+        ts_mode = other.ts_mode;
+        tx_counter = other.tx_counter;
+        tx_stamps = std::move(other.tx_stamps);
     }
-    if ((int)sockfd < 0) {
+    return *this;
+}
+
+
+IcmpSocket::~IcmpSocket(){
+    if (sockfd >= 0){
         close(sockfd);
-        clear_addrinfo(addrinfo_list);
-        throw std::runtime_error("Failed to create socket for all addresses");
     }
+}
 
-    set_addr(addrinfo);
-    // make socket non-blocking for timeout feature
-    if (fcntl(sockfd, F_SETFL, O_NONBLOCK) == -1) {
-        clear_addrinfo(addrinfo_list);
-        throw std::runtime_error("Failed to make socket non-blocking");
+
+socket_t IcmpSocket::get_fd() const{
+    return sockfd;
+}
+
+
+// prefer kernel TX+RX software timestamps, then RX only, then user-space
+void IcmpSocket::enable_timestamps(){
+    int flags = SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_TX_SOFTWARE |
+                SOF_TIMESTAMPING_RX_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID |
+                SOF_TIMESTAMPING_OPT_TSONLY;
+    int enable = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0){
+        ts_mode = TS_KERNEL;
+    } else if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0){
+        ts_mode = TS_RX;
+    } else {
+        ts_mode = TS_USER;
     }
+    tx_counter = 0;
+    tx_stamps.assign(TX_STAMPS_RING_SIZE, TxStamp{UINT32_MAX, 0});
+}
+
+
+// ring size stays power of 2, stamps of probes already sent are dropped on resize
+void IcmpSocket::reserve_tx_stamps(size_t in_flight){
+    if (in_flight <= tx_stamps.size()){
+        return;
+    }
+    size_t size = tx_stamps.size();
+    while (size < in_flight){
+        size <<= 1;
+    }
+    tx_stamps.assign(size, TxStamp{UINT32_MAX, 0});
+}
+
+
+// Read TX timestamps from socket error queue (SOF_TIMESTAMPING_OPT_ID keys)
+void IcmpSocket::drain_tx_stamps(){
+    for (;;) {
+        char packet_info_buf[TX_INFO_BUFFER_SIZE];
+        struct msghdr msg = { NULL, 0,
+                              NULL, 0,
+                              packet_info_buf, sizeof(packet_info_buf),
+                              0 };
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE) < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return;     // EAGAIN: error queue is empty
+        }
+        int64_t ts = 0;
+        struct sock_extended_err* serr = NULL;
+        for (cmsghdr_t* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING){
+                ts = timespec_to_ns(((struct scm_timestamping*)CMSG_DATA(cmsg))->ts[0]);
+            } else if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR){
+                serr = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            }
+        }
+        if (serr != NULL && serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && ts != 0){
+            tx_stamps[serr->ee_data & (tx_stamps.size() - 1)] = TxStamp{serr->ee_data, ts};
+        }
+    }
+}
+
+
+bool IcmpSocket::find_tx_stamp(uint32_t tx_id, int64_t& ts){
+    for (int attempt = 0; attempt < 2; attempt++){
+        const TxStamp& stamp = tx_stamps[tx_id & (tx_stamps.size() - 1)];
+        if (stamp.tx_id == tx_id){
+            ts = stamp.ts;
+            return true;
+        }
+        drain_tx_stamps();
+    }
+    return false;
+}
+
+
+// kernel timestamps when available for both ends, user-space otherwise
+int64_t IcmpSocket::compute_rtt_ns(const ProbeSendInfo& sent, const EchoReply& reply){
+    int64_t rtt = -1;
+    if (reply.rx_time != 0){
+        int64_t tx_time;
+        if (ts_mode == TS_KERNEL && find_tx_stamp(sent.tx_id, tx_time)){
+            rtt = reply.rx_time - tx_time;
+        } else if (ts_mode == TS_RX){
+            // kernel stamp is CLOCK_REALTIME, send time is monotonic
+            rtt = reply.rx_time - reply.clock_offset - sent.send_time;
+        }
+    }
+    if (rtt < 0){
+        rtt = reply.user_rx_time - sent.send_time;
+    }
+    return rtt;
 }
 
 void Pinger::set_addr(struct addrinfo* addrinfo){
@@ -133,96 +217,319 @@ void Pinger::set_addr(struct addrinfo* addrinfo){
 }
 
 
-struct icmp create_request(sockaddr_storage addr, int id, int seq){
-    struct icmp request;
-    request.icmp_type = ICMP_ECHO;
-    request.icmp_code = 0;
-    request.icmp_cksum = 0;
-    request.icmp_id = htons(id);
-    request.icmp_seq = htons(seq);
-    request.icmp_cksum = compute_checksum((char *)&request, sizeof(request));
-    return request;
+// fill buf with echo request carrying payload, return packet length
+static size_t create_request(char* buf, int id, int seq, const ProbePayload& payload){
+    struct icmphdr* request = (struct icmphdr*)buf;
+    request->type = ICMP_ECHO;
+    request->code = 0;
+    request->checksum = 0;
+    request->un.echo.id = htons(id);
+    request->un.echo.sequence = htons(seq);
+    memcpy(buf + ICMP_HEADER_LENGTH, &payload, sizeof(payload));
+    size_t len = ICMP_HEADER_LENGTH + sizeof(payload);
+    request->checksum = compute_checksum(buf, len);
+    return len;
 }
 
 
-PingRes Pinger::ping(int seq, int id){
-    int delay = -1;
-    bool bad_checksum = false;
-    if (id == -1){
-        id = (uint16_t)getpid();
-    }
-    struct icmp request = create_request(addr, id, seq);
+// user-space send timestamp is also stored in payload
+ProbeSendInfo IcmpSocket::send_echo(const struct sockaddr_storage& dst, socklen_t dst_len, int seq, int id){
+    char packet[ICMP_HEADER_LENGTH + sizeof(ProbePayload)];
+    ProbePayload payload;
+    payload.seq = (uint32_t)seq;
+    payload.reserved = 0;
+    payload.send_time = monotonic_ns();
+    size_t len = create_request(packet, id, seq, payload);
 
-    if (sendto(sockfd, (char *)&request, sizeof(request), 0, 
-               (struct sockaddr *)&addr, (int)dst_addr_len) <= 0){
-        close(sockfd);
+    if (sendto(sockfd, packet, len, 0, 
+               (const struct sockaddr *)&dst, dst_len) <= 0){
         throw std::runtime_error(strerror(errno));
     }
-    int start_time = utime();
+    return ProbeSendInfo{payload.send_time, tx_counter++};
+}
 
-    // wait and process reply
+
+/* Send 'count' echo requests with consecutive sequence numbers in one sendmmsg
+ * (repeated only if kernel accepts part of the batch).
+ */
+void IcmpSocket::send_echo_burst(const struct sockaddr_storage& dst, socklen_t dst_len, int first_seq,
+                                 int count, int id, std::vector<ProbeSendInfo>& sent){
+    const size_t pkt_len = ICMP_HEADER_LENGTH + sizeof(ProbePayload);
+    std::vector<char> packets(count * pkt_len);
+    std::vector<struct iovec> iovecs(count);
+    std::vector<struct mmsghdr> msgs(count);
+    int64_t send_time = monotonic_ns();
+    for (int i = 0; i < count; i++){
+        ProbePayload payload;
+        payload.seq = (uint32_t)(first_seq + i);
+        payload.reserved = 0;
+        payload.send_time = send_time;
+        char* packet = packets.data() + i * pkt_len;
+        create_request(packet, id, first_seq + i, payload);
+        iovecs[i] = { packet, pkt_len };
+        msgs[i].msg_hdr = { (void*)&dst, dst_len,
+                            &iovecs[i], 1,
+                            NULL, 0,
+                            0 };
+    }
+
+    int nsent = 0;
+    while (nsent < count){
+        int res = sendmmsg(sockfd, msgs.data() + nsent, count - nsent, 0);
+        if (res < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            throw std::runtime_error(strerror(errno));
+        }
+        nsent += res;
+    }
+
+    sent.clear();
+    for (int i = 0; i < count; i++){
+        sent.push_back(ProbeSendInfo{send_time, tx_counter++});
+    }
+}
+
+
+ProbeSendInfo Pinger::send_echo(int seq, int id){
+    return sock.send_echo(addr, dst_addr_len, seq, id);
+}
+
+
+// Parse received packet (with IP header), returns false if it is not an echo reply
+static bool parse_echo_reply(char* msg_buf, size_t msg_len, struct msghdr* msg, EchoReply& reply){
+    // For IPv4, we must take the length of the IP header into account.
+    size_t ip_hdr_len = ((*(uint8_t *)msg_buf) & 0x0F) * 4;
+    if (msg_len < ip_hdr_len + ICMP_HEADER_LENGTH){
+        return false;
+    }
+    struct icmp* reply_pkt = (struct icmp *)(msg_buf + ip_hdr_len);
+
+    // Verify that this is indeed an echo reply packet.
+    if (reply_pkt->icmp_type != ICMP_ECHO_REPLY){
+        return false;
+    }
+    reply.id = ntohs(reply_pkt->icmp_id);
+    reply.seq = ntohs(reply_pkt->icmp_seq);
+    reply.user_rx_time = monotonic_ns();
+    reply.clock_offset = realtime_ns() - reply.user_rx_time;
+    reply.rx_time = 0;
+    for (cmsghdr_t* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)){
+        if (cmsg->cmsg_level != SOL_SOCKET){
+            continue;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING){
+            reply.rx_time = timespec_to_ns(((struct scm_timestamping*)CMSG_DATA(cmsg))->ts[0]);
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPNS){
+            reply.rx_time = timespec_to_ns(*(struct timespec*)CMSG_DATA(cmsg));
+        }
+    }
+
+    // Verify the checksum.
+    uint16_t reply_checksum = reply_pkt->icmp_cksum;
+    reply_pkt->icmp_cksum = 0;
+    reply.bad_checksum = reply_checksum != compute_checksum(msg_buf + ip_hdr_len, msg_len - ip_hdr_len);
+
+    reply.has_payload = msg_len - ip_hdr_len - ICMP_HEADER_LENGTH >= sizeof(ProbePayload);
+    if (reply.has_payload){
+        memcpy(&reply.payload, msg_buf + ip_hdr_len + ICMP_HEADER_LENGTH, sizeof(ProbePayload));
+    }
+    return true;
+}
+
+
+/* Read one echo reply from non-blocking socket. Other ICMP packets are skipped.
+ * Returns 1 if reply was read, 0 if no data available, -1 on error.
+ */
+int IcmpSocket::recv_echo_reply(EchoReply& reply){
     for (;;) {
         char msg_buf[MESSAGE_BUFFER_SIZE];
         char packet_info_buf[MESSAGE_BUFFER_SIZE];
         struct iovec msg_buf_struct = { msg_buf, sizeof(msg_buf) };
-        struct msghdr msg = { NULL, 0,
+        struct msghdr msg = { &reply.src, sizeof(reply.src),
                               &msg_buf_struct, 1,
                               packet_info_buf, sizeof(packet_info_buf),
                               0 };
-        size_t msg_len;
-        //cmsghdr_t *cmsg;
-        size_t ip_hdr_len;
-        struct icmp *reply;
-        int reply_id;
-        int reply_seq;
-        uint16_t reply_checksum;
-        uint16_t checksum;
         int error = (int)recvmsg(sockfd, &msg, 0);
-        delay = utime() - start_time;
 
         if (error < 0) {
-            if (errno == EAGAIN) {
-                if (delay > ping_timeout) {
-                    fprintf(stderr, "timeout exceeded\n");
-                    return PingRes(-1);
-                } else {
-                    /* No data available yet, try to receive again. */
-                    continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (ts_mode == TS_KERNEL){
+                    drain_tx_stamps();  // also clears POLLERR for ppoll
                 }
-            } else {
-                perror("recvmsg");
-                break;
+                return 0;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (parse_echo_reply(msg_buf, error, &msg, reply)){
+            return 1;
+        }
+    }
+}
+
+
+/* Read up to max_replies (<= RECV_BATCH_SIZE) echo replies with one recvmmsg.
+ * Returns number of echo replies read (0 if none), -1 on error.
+ */
+int IcmpSocket::recv_echo_replies(EchoReply* replies, int max_replies){
+    char msg_bufs[RECV_BATCH_SIZE][MESSAGE_BUFFER_SIZE];
+    char packet_info_bufs[RECV_BATCH_SIZE][MESSAGE_BUFFER_SIZE];
+    struct sockaddr_in srcs[RECV_BATCH_SIZE];
+    struct iovec iovecs[RECV_BATCH_SIZE];
+    struct mmsghdr msgs[RECV_BATCH_SIZE];
+    int batch = std::min(max_replies, RECV_BATCH_SIZE);
+    for (int i = 0; i < batch; i++){
+        iovecs[i] = { msg_bufs[i], sizeof(msg_bufs[i]) };
+        msgs[i].msg_hdr = { &srcs[i], sizeof(srcs[i]),
+                            &iovecs[i], 1,
+                            packet_info_bufs[i], sizeof(packet_info_bufs[i]),
+                            0 };
+        msgs[i].msg_len = 0;
+    }
+
+    int nmsgs;
+    while ((nmsgs = recvmmsg(sockfd, msgs, batch, MSG_DONTWAIT, NULL)) < 0 && errno == EINTR){}
+    if (nmsgs < 0){
+        if (errno == EAGAIN || errno == EWOULDBLOCK){
+            if (ts_mode == TS_KERNEL){
+                drain_tx_stamps();
             }
+            return 0;
         }
-        msg_len = error;
-        // For IPv4, we must take the length of the IP header into account.
-        ip_hdr_len = ((*(uint8_t *)msg_buf) & 0x0F) * 4;
+        return -1;
+    }
+
+    int nreplies = 0;
+    for (int i = 0; i < nmsgs; i++){
+        if (parse_echo_reply(msg_bufs[i], msgs[i].msg_len, &msgs[i].msg_hdr, replies[nreplies])){
+            replies[nreplies].src = srcs[i];
+            nreplies += 1;
+        }
+    }
+    return nreplies;
+}
 
-        reply = (struct icmp *)(msg_buf + ip_hdr_len);
-        reply_id = ntohs(reply->icmp_id);
-        reply_seq = ntohs(reply->icmp_seq);
 
-        
-        // Verify that this is indeed an echo reply packet.
-        if (!(addr.ss_family == AF_INET && reply->icmp_type == ICMP_ECHO_REPLY)){
+PingRes Pinger::ping(int seq, int id){
+    PHASE_TIMER(PHASE_PING);
+    int delay = -1;     // microseconds, for timeout
+    if (id == -1){
+        id = (uint16_t)getpid();
+    }
+    ProbeSendInfo sent = send_echo(seq, id);
+
+    // wait and process reply
+    for (;;) {
+        EchoReply reply;
+        int error = sock.recv_echo_reply(reply);
+        delay = (monotonic_ns() - sent.send_time) / 1000;
+
+        if (error == 0) {
+            if (delay >= ping_timeout) {
+                fprintf(stderr, "timeout exceeded\n");
+                return PingRes(-1);
+            }
+            /* No data available yet, sleep in kernel until reply or deadline. */
+            if (sock.wait_readable(ping_timeout - delay) < 0) {
+                perror("ppoll");
+                break;
+            }
             continue;
+        } else if (error < 0) {
+            perror("recvmsg");
+            break;
         }
 
         // Verify the ID and sequence number to make sure that the reply is associated with the current request.
-        if (reply_id != id || reply_seq != seq) {
+        if (reply.id != id || reply.seq != (uint16_t)seq) {
             continue;
         }
+        return PingRes::from_ns(sock.compute_rtt_ns(sent, reply), reply.bad_checksum);
+    }
+
+    return PingRes(delay);
+}
+
+
+std::vector<PingRes> Pinger::ping_series(int first_seq, int count, int gap, int id){
+    PHASE_TIMER(PHASE_PING_SERIES);
+    std::vector<PingRes> results;
+    results.reserve(count);
+    for (int i = 0; i < count; i++){
+        results.push_back(ping(first_seq + i, id));
+        int rtt = results.back().rtt;
+        if (i + 1 < count && (0 <= rtt) && (rtt < gap)){
+            usleep(gap - rtt);
+        }
+    }
+    return results;
+}
 
 
-        reply_checksum = reply->icmp_cksum;
-        reply->icmp_cksum = 0;        
-        // Verify the checksum.
-        checksum = compute_checksum(msg_buf + ip_hdr_len, msg_len - ip_hdr_len);
-        bad_checksum = reply_checksum != checksum;
-        break;
+// one sendmmsg for whole burst, replies are drained with recvmmsg
+std::vector<PingRes> Pinger::ping_burst(int first_seq, int count, int id){
+    PHASE_TIMER(PHASE_PING_SERIES);
+    if (count <= 0){
+        return std::vector<PingRes>();
+    }
+    if (id == -1){
+        id = (uint16_t)getpid();
     }
+    std::vector<ProbeSendInfo> sent;
+    sock.send_echo_burst(addr, dst_addr_len, first_seq, count, id, sent);
+
+    std::vector<PingRes> results(count);    // lost by default
+    std::vector<bool> answered(count, false);
+    EchoReply replies[RECV_BATCH_SIZE];
+    int outstanding = count;
+    const int64_t deadline = sent.back().send_time + ping_timeout * 1000LL;
+    while (outstanding > 0){
+        int nreplies = sock.recv_echo_replies(replies, RECV_BATCH_SIZE);
+        if (nreplies < 0){
+            perror("recvmmsg");
+            break;
+        }
+        for (int i = 0; i < nreplies; i++){
+            const EchoReply& reply = replies[i];
+            int idx = (uint16_t)(reply.seq - first_seq);
+            if (reply.id != id || idx >= count){
+                continue;
+            }
+            if (answered[idx]){
+                n_duplicates += 1;
+                continue;
+            }
+            answered[idx] = true;
+            outstanding -= 1;
+            results[idx] = PingRes::from_ns(sock.compute_rtt_ns(sent[idx], reply), reply.bad_checksum);
+        }
+        if (nreplies == 0){
+            int64_t now = monotonic_ns();
+            if (now >= deadline){
+                break;
+            }
+            sock.wait_readable((deadline - now + 999) / 1000);
+        }
+    }
+    return results;
+}
+
+
+int Pinger::get_window() const{
+    return 1;
+}
+
+
+unsigned Pinger::get_duplicates() const{
+    return n_duplicates;
+}
+
 
-    return PingRes(delay, bad_checksum);
+unsigned Pinger::get_reordered() const{
+    return n_reordered;
 }
 
 
@@ -244,13 +551,21 @@ std::unique_ptr<Pinger> Pinger::to_unique_ptr(){
 }
 
 /////////////////// PingRes
-PingRes::PingRes(int _rtt, bool _checksum): rtt(_rtt), bad_checksum(_checksum) {};
+PingRes::PingRes(int _rtt, bool _checksum): rtt(_rtt), rtt_ns(_rtt < 0 ? -1 : _rtt * 1000LL),
+bad_checksum(_checksum) {};
+
+PingRes PingRes::from_ns(int64_t _rtt_ns, bool _checksum){
+    PingRes res((int)(_rtt_ns / 1000), _checksum);
+    res.rtt_ns = _rtt_ns;
+    return res;
+}
 
 
 /////////////////// PingStat
-PingStat::PingStat(): srtt(0), jitter(0), lost(0), total(0), curr_rtt(0), prev_rtt(0) {};
+PingStat::PingStat(): srtt(0), jitter(0), lost(0), total(0), curr_rtt(0), prev_rtt(0),
+rtt_window(RTT_WINDOW_SLICES), curr_slice(-1), window_dirty(true) {};
 
-void PingStat::process_ping_res(const PingRes& res, int seq=-1, bool verbose){
+void PingStat::process_ping_res(const PingRes& res, int seq, bool verbose, int64_t now){
     total += 1;
     if (res.rtt == -1){
         lost += 1;
@@ -264,18 +579,19 @@ void PingStat::process_ping_res(const PingRes& res, int seq=-1, bool verbose){
         return;
     }
     if (verbose)
-        printf("Request seq=%d rtt=%.3f ms\n", seq, res.rtt / 1000.0);
+        printf("Request seq=%d rtt=%.3f ms\n", seq, res.rtt_ns / 1000000.0);
     prev_rtt = curr_rtt;
-    curr_rtt = res.rtt;
+    curr_rtt = res.rtt_ns / 1000.;
     update_jitter();
     update_srtt();
+    update_quantiles(res.rtt_ns, now < 0 ? monotonic_ns() : now);
 }
 
 /* https://datatracker.ietf.org/doc/html/rfc1889#page-71 */
 void PingStat::update_jitter(){
-    int diff = curr_rtt - prev_rtt;
+    double diff = curr_rtt - prev_rtt;
     if (diff < 0) diff = -diff;
-    jitter += (int) ((diff - jitter) * 1./16.);
+    jitter += (diff - jitter) * 1./16.;
 }
 
 void PingStat::update_srtt(){
@@ -284,15 +600,54 @@ void PingStat::update_srtt(){
         srtt = curr_rtt;
         return;
     }
-    srtt = (int) (ALPHA * srtt + (1-ALPHA) * curr_rtt);
+    srtt = ALPHA * srtt + (1-ALPHA) * curr_rtt;
+}
+
+// O(1) except for rotating to new slice, which clears one histogram per slice duration
+void PingStat::update_quantiles(int64_t rtt_ns, int64_t now){
+    int64_t slice = now / (RTT_WINDOW_SEC * 1000000000LL / RTT_WINDOW_SLICES);
+    if (slice != curr_slice){
+        int64_t nclear = (curr_slice < 0) ? RTT_WINDOW_SLICES
+                         : std::min<int64_t>(slice - curr_slice, RTT_WINDOW_SLICES);
+        for (int64_t i = 1; i <= nclear; i++){
+            rtt_window[(slice - nclear + i) % RTT_WINDOW_SLICES].reset();
+        }
+        curr_slice = slice;
+    }
+    rtt_window[curr_slice % RTT_WINDOW_SLICES].record(rtt_ns);
+    rtt_lifetime.record(rtt_ns);
+    window_dirty = true;
+}
+
+const LogLinearHistogram& PingStat::get_rtt_histogram(bool lifetime) const{
+    if (lifetime){
+        return rtt_lifetime;
+    }
+    if (window_dirty){
+        rtt_window_merged.reset();
+        for (const auto& slice: rtt_window){
+            rtt_window_merged.merge(slice);
+        }
+        window_dirty = false;
+    }
+    return rtt_window_merged;
 }
 
 int PingStat::get_jitter() const{
-    return jitter;
+    return (int)jitter;
 }
 
 int PingStat::get_srtt() const{
-    return srtt;
+    return (int)srtt;
+}
+
+// over last RTT_WINDOW_SEC seconds or whole lifetime
+int PingStat::get_rtt_percentile(double percentile, bool lifetime) const{
+    return get_rtt_histogram(lifetime).get_percentile(percentile) / 1000;
+}
+
+int PingStat::get_max_rtt(bool lifetime) const{
+    return get_rtt_histogram(lifetime).get_max() / 1000;
 }
 
 // percentage
@@ -301,7 +656,7 @@ double PingStat::get_loss() const{
 }
 
 int PingStat::get_last_rtt() const{
-    return curr_rtt;
+    return (int)curr_rtt;
 }
 
 void PingStat::print_statistics() const{
@@ -309,38 +664,149 @@ void PingStat::print_statistics() const{
     fprintf(stdout, "Total packets: %d, lost packets: %d, loss percentage: %.3f %%\n",
             total, lost, get_loss());
     fprintf(stdout, "sRTT: %.3f ms, jitter: %.3f ms\n", srtt / 1000., jitter / 1000.);
+    fprintf(stdout, "RTT p50: %.3f ms, p90: %.3f ms, p99: %.3f ms, max: %.3f ms\n",
+            get_rtt_percentile(50, true) / 1000., get_rtt_percentile(90, true) / 1000.,
+            get_rtt_percentile(99, true) / 1000., get_max_rtt(true) / 1000.);
+}
+
+static int round_up_pow2(int n){
+    int res = 1;
+    while (res < n){
+        res <<= 1;
+    }
+    return res;
 }
 
+
+static struct timespec ns_to_timespec(int64_t ns){
+    return { (time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL) };
+}
+
+
 // ContinuosPinger
 ContinuosPinger::ContinuosPinger(const char* _hostname, int _ping_gap, int _ping_timeout):
-Pinger(_hostname, _ping_timeout), ping_gap(_ping_gap) {};
+Pinger(_hostname, _ping_timeout), ping_gap(_ping_gap)
+{
+    if (ping_gap <= 0){
+        throw std::runtime_error("Ping gap must be positive");
+    }
+    // slot is reused only after probe in it has expired (or 65536 gaps later)
+    slots.resize(std::min(round_up_pow2(ping_timeout / ping_gap + 2), MAX_PING_SLOTS));
+    slot_mask = slots.size() - 1;
+    sock.reserve_tx_stamps(slots.size());
+};
 
 namespace ping_handler{
-    bool ping_stopped = false;
+    volatile sig_atomic_t ping_stopped = 0;
 
     void stop_ping(int signo){
-        ping_stopped = true;
+        ping_stopped = 1;
     }
 }
 
 
+/* Probes leave on absolute CLOCK_MONOTONIC grid (timerfd) whether or not
+ * earlier replies came back; replies are matched through ring of probe slots.
+ */
 void ContinuosPinger::ping_continuously(){
-    PingRes tmp_res;
     PingStat stats;
-    ping_handler::ping_stopped = false;
+    ping_handler::ping_stopped = 0;
     uint16_t id = (uint16_t)getpid();
+    const int64_t gap = ping_gap * 1000LL;          // nanoseconds
+    const int64_t timeout = ping_timeout * 1000LL;  // nanoseconds
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timer_fd < 0){
+        throw std::runtime_error(std::string("timerfd_create: ") + strerror(errno));
+    }
+    const int64_t start = timer_clock_ns();     // timerfd grid is on CLOCK_MONOTONIC
+    struct itimerspec grid = { ns_to_timespec(gap), ns_to_timespec(start) };
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &grid, NULL) < 0){
+        close(timer_fd);
+        throw std::runtime_error(std::string("timerfd_settime: ") + strerror(errno));
+    }
+
+    for (auto& slot: slots){
+        slot.seq = -1;
+        slot.outstanding = slot.answered = false;
+    }
+    send_lateness.reset();
+    unsigned tick = 0;      // grid point of next probe, also its seq
+    unsigned oldest = 0;    // oldest probe which may wait for reply
+
     auto prev_handler = signal(SIGINT, ping_handler::stop_ping);  // break from loop after sigint
-    for (unsigned seq = 0; !ping_handler::ping_stopped; seq++) {
-        tmp_res = ping(seq, id);
-        stats.process_ping_res(tmp_res, seq);
-        if ((0 <= tmp_res.rtt) && (tmp_res.rtt < ping_gap)){
-            usleep(ping_gap - tmp_res.rtt);
+    while (!ping_handler::ping_stopped) {
+        // expire probes in send order
+        int64_t now = monotonic_ns();
+        while (oldest != tick){
+            ProbeSlot& slot = slots[oldest & slot_mask];
+            if (slot.outstanding && (unsigned)slot.seq == oldest){
+                if (now - slot.sent.send_time < timeout){
+                    break;
+                }
+                slot.outstanding = false;
+                stats.process_ping_res(PingRes(-1), oldest);
+            }
+            oldest += 1;
+        }
+        struct timespec expire_wait;
+        struct timespec* wait = NULL;
+        if (oldest != tick){
+            expire_wait = ns_to_timespec(slots[oldest & slot_mask].sent.send_time + timeout - now);
+            wait = &expire_wait;
+        }
+
+        struct pollfd pfds[2] = { { timer_fd, POLLIN, 0 }, { sock.get_fd(), POLLIN, 0 } };
+        if (ppoll(pfds, 2, wait, NULL) < 0 && errno != EINTR){
+            perror("ppoll");
+            break;
+        }
+
+        uint64_t expirations = 0;
+        if ((pfds[0].revents & POLLIN) &&
+            read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0){
+            // missed grid points are skipped, probe goes for the latest one
+            tick += expirations - 1;
+            send_lateness.record(timer_clock_ns() - (start + (int64_t)tick * gap));
+            ProbeSlot& slot = slots[tick & slot_mask];
+            if (slot.outstanding){
+                stats.process_ping_res(PingRes(-1), slot.seq);
+            }
+            slot.seq = tick;
+            slot.sent = send_echo(tick, id);
+            slot.outstanding = true;
+            tick += 1;
+        }
+
+        EchoReply reply;
+        int error;
+        while ((error = sock.recv_echo_reply(reply)) > 0){
+            ProbeSlot& slot = slots[reply.seq & slot_mask];
+            if (reply.id != id || !slot.outstanding || (uint16_t)slot.seq != reply.seq){
+                continue;   // not ours, duplicate or late reply
+            }
+            slot.outstanding = false;
+            stats.process_ping_res(PingRes::from_ns(sock.compute_rtt_ns(slot.sent, reply), reply.bad_checksum),
+                                   slot.seq);
+        }
+        if (error < 0){
+            perror("recvmsg");
+            break;
         }
     }
+    close(timer_fd);
     stats.print_statistics();
+    fprintf(stdout, "Send lateness: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            send_lateness.get_percentile(50) / 1e6, send_lateness.get_percentile(99) / 1e6,
+            send_lateness.get_max() / 1e6);
     signal(SIGINT, prev_handler);   // return default handler
 }
 
+
+const LogLinearHistogram& ContinuosPinger::get_send_lateness() const{
+    return send_lateness;
+}
+
 int ContinuosPinger::get_ping_gap() const{
     return ping_gap;
 }
@@ -349,3 +815,186 @@ int ContinuosPinger::get_ping_gap() const{
 std::unique_ptr<Pinger> ContinuosPinger::to_unique_ptr(){
     return std::make_unique<ContinuosPinger>(std::move(*this));
 }
+
+
+// PipelinedPinger
+
+socket_t Pinger::get_fd() const{
+    return sock.get_fd();
+}
+
+
+void Pinger::start_series(int first_seq, int count, int gap, int id, int window){
+    count = std::max(count, 0);
+    if (window <= 0){
+        window = get_window();
+    }
+    window = std::min(window, MAX_PING_WINDOW);
+    if (slots.size() < (size_t)window){
+        slots.resize(round_up_pow2(window));
+        slot_mask = slots.size() - 1;
+        sock.reserve_tx_stamps(slots.size());
+        for (auto& slot: slots){
+            slot.seq = -1;
+            slot.outstanding = slot.answered = false;
+        }
+    } else if (series.outstanding > 0){
+        for (auto& slot: slots){    // previous series was aborted
+            slot.outstanding = false;
+        }
+    }
+    series.first_seq = first_seq;
+    series.count = count;
+    series.gap = gap * 1000LL;
+    series.id = id == -1 ? (uint16_t)getpid() : id;
+    series.window = window;
+    series.next = 0;
+    series.oldest = 0;
+    series.outstanding = 0;
+    series.highest_seq = -1;
+    series.start_time = series.next_send_time = timer_clock_ns();
+    series.active = count > 0;
+    series.results.assign(count, PingRes());    // lost by default
+}
+
+
+int64_t Pinger::series_step(){
+    if (!series.active){
+        return -1;
+    }
+    const int64_t timeout = ping_timeout * 1000LL;    // nanoseconds
+    int64_t now = timer_clock_ns();
+    // expire probes in send order
+    while (series.oldest < series.next){
+        ProbeSlot& slot = slots[(series.first_seq + series.oldest) & slot_mask];
+        if (slot.outstanding){
+            if (now < slot.expire_time){
+                break;
+            }
+            slot.outstanding = false;
+            series.outstanding -= 1;
+        }
+        series.oldest += 1;
+    }
+
+    // span is limited by window so slots of unexpired probes are never reused
+    int nsend = std::min(series.count - series.next, series.window - (series.next - series.oldest));
+    if (nsend > 0 && now >= series.next_send_time){
+        if (series.gap != 0){
+            nsend = 1;
+        }
+        int first = series.first_seq + series.next;
+        if (nsend > 1){
+            sock.send_echo_burst(addr, dst_addr_len, first, nsend, series.id, burst_sent);
+        }
+        for (int i = 0; i < nsend; i++){
+            ProbeSlot& slot = slots[(first + i) & slot_mask];
+            slot.seq = first + i;
+            slot.res_idx = series.next + i;
+            slot.outstanding = true;
+            slot.answered = false;
+            slot.sent = nsend > 1 ? burst_sent[i] : send_echo(slot.seq, series.id);
+            slot.expire_time = now + timeout;
+        }
+        series.outstanding += nsend;
+        series.next += nsend;
+        series.next_send_time += series.gap;
+    }
+
+    if (series.next == series.count && series.outstanding == 0){
+        series.active = false;
+        if (phase_timers_enabled()){
+            phase_timers::record(PHASE_PING_SERIES, timer_clock_ns() - series.start_time);
+        }
+        return -1;
+    }
+    // next send or oldest probe expiration
+    int64_t wakeup = INT64_MAX;
+    if (series.next < series.count && series.next - series.oldest < series.window){
+        wakeup = series.next_send_time;
+    }
+    if (series.outstanding > 0){
+        wakeup = std::min(wakeup, slots[(series.first_seq + series.oldest) & slot_mask].expire_time);
+    }
+    return wakeup;
+}
+
+
+void Pinger::series_on_readable(){
+    EchoReply replies[RECV_BATCH_SIZE];
+    int nreplies;
+    while ((nreplies = sock.recv_echo_replies(replies, RECV_BATCH_SIZE)) > 0){
+        for (int i = 0; i < nreplies; i++){
+            if (series.active && replies[i].id == series.id){
+                process_reply(replies[i]);
+            }
+        }
+    }
+    if (nreplies < 0){
+        perror("recvmmsg");
+        series.active = false;  // unanswered probes stay lost
+    }
+}
+
+
+const std::vector<PingRes>& Pinger::get_series_results() const{
+    return series.results;
+}
+
+
+void Pinger::process_reply(const EchoReply& reply){
+    ProbeSlot& slot = slots[reply.seq & slot_mask];
+    if (slot.seq == -1 || (uint16_t)slot.seq != reply.seq){
+        return;     // reply for probe that already left the window
+    }
+    if (slot.answered){
+        n_duplicates += 1;
+        return;
+    }
+    if (!slot.outstanding){
+        return;     // late reply for probe considered lost
+    }
+    slot.answered = true;
+    slot.outstanding = false;
+    series.outstanding -= 1;
+    if (slot.seq < series.highest_seq){
+        n_reordered += 1;
+    } else {
+        series.highest_seq = slot.seq;
+    }
+    series.results[slot.res_idx] = PingRes::from_ns(sock.compute_rtt_ns(slot.sent, reply), reply.bad_checksum);
+}
+
+
+PipelinedPinger::PipelinedPinger(const char* _hostname, int _window, int _ping_timeout):
+Pinger(_hostname, _ping_timeout), window(_window < 1 ? 1 : _window)
+{
+    if (window > 0x8000){
+        throw std::runtime_error("Ping window must not exceed half of 16-bit sequence space");
+    }
+}
+
+
+// blocking wrapper around series engine
+std::vector<PingRes> PipelinedPinger::ping_series(int first_seq, int count, int gap, int id){
+    start_series(first_seq, count, gap, id);
+    int64_t wakeup;
+    while ((wakeup = series_step()) >= 0){
+        int64_t now = timer_clock_ns();
+        if (wakeup > now){
+            sock.wait_readable((wakeup - now + 999) / 1000);
+        }
+        series_on_readable();
+    }
+    return series.results;
+}
+
+
+int PipelinedPinger::get_window() const{
+    return window;
+}
+
+
+std::unique_ptr<Pinger> PipelinedPinger::to_unique_ptr(){
+    return std::make_unique<PipelinedPinger>(std::move(*this));
+}
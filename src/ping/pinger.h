@@ -17,12 +17,18 @@
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>  /* struct icmp */
+#include <poll.h>             /* ppoll() */
 #include <sys/socket.h>
+#include <linux/errqueue.h>   /* struct sock_extended_err, scm_timestamping */
+#include <linux/net_tstamp.h> /* SOF_TIMESTAMPING_* */
 #include <sys/time.h>
+#include <sys/timerfd.h>      /* timerfd_create() */
 #include <sys/types.h>
 #include <string>
 #include <csignal>
 #include <memory>
+#include <vector>
+#include "../util/histogram.h"
 
 // in microseconds
 #define DEFAULT_PING_GAP 1000000
@@ -31,6 +37,26 @@
 // bytes
 #define ICMP_HEADER_LENGTH 8
 #define MESSAGE_BUFFER_SIZE 128
+#define TX_INFO_BUFFER_SIZE 256
+
+// messages per recvmmsg
+#define RECV_BATCH_SIZE 32
+
+// kernel TX timestamps kept for matching with replies, at least (grows with probes in flight)
+#define TX_STAMPS_RING_SIZE 1024
+
+// sliding window for RTT quantiles
+#define RTT_WINDOW_SEC 300
+#define RTT_WINDOW_SLICES 10
+
+// probes in flight for PipelinedPinger
+#define DEFAULT_PING_WINDOW 8
+
+// probes in flight (or in one burst) at most, replies are matched by 16-bit sequence number
+#define MAX_PING_WINDOW 32768
+
+// ring of probe slots is indexed by 16-bit sequence number
+#define MAX_PING_SLOTS 65536
 
 #ifndef ICMP_ECHO
     #define ICMP_ECHO 8
@@ -44,34 +70,115 @@ typedef struct msghdr msghdr_t;
 typedef struct cmsghdr cmsghdr_t;
 
 
+// Payload of every echo request, echoed back by the remote host
+struct ProbePayload {
+    uint32_t seq;
+    uint32_t reserved;
+    int64_t send_time;  // monotonic, nanoseconds
+};
+
+
+struct ProbeSendInfo {
+    int64_t send_time;  // user-space monotonic, nanoseconds
+    uint32_t tx_id;     // key of kernel TX timestamp
+};
+
+
+struct EchoReply {
+    struct sockaddr_in src;
+    int id;
+    int seq;            // 16-bit ICMP sequence number
+    bool bad_checksum;
+    bool has_payload;
+    ProbePayload payload;
+    int64_t rx_time;        // kernel RX timestamp, CLOCK_REALTIME nanoseconds (0 if unavailable)
+    int64_t user_rx_time;   // monotonic, nanoseconds
+    int64_t clock_offset;   // realtime - monotonic at reception, pairs rx_time with send time
+};
+
+void resolve_addr(const char* hostname, struct addrinfo** addrinfo_list);
+void clear_addrinfo(struct addrinfo* addrinfo_list);
+
+
+// Non-blocking raw ICMP socket with kernel timestamping, can be shared by many destinations
+class IcmpSocket{
+public:
+    IcmpSocket();
+    IcmpSocket(const IcmpSocket& other) = delete;
+    IcmpSocket& operator=(const IcmpSocket& other) = delete;
+    IcmpSocket(IcmpSocket&& other);
+    IcmpSocket& operator=(IcmpSocket&& other);
+    ~IcmpSocket();
+
+    ProbeSendInfo send_echo(const struct sockaddr_storage& dst, socklen_t dst_len, int seq, int id);
+    void send_echo_burst(const struct sockaddr_storage& dst, socklen_t dst_len, int first_seq, int count,
+                         int id, std::vector<ProbeSendInfo>& sent);
+    int recv_echo_reply(EchoReply& reply);
+    int recv_echo_replies(EchoReply* replies, int max_replies);
+    int64_t compute_rtt_ns(const ProbeSendInfo& sent, const EchoReply& reply);
+    int wait_readable(int timeout);     // microseconds
+    void reserve_tx_stamps(size_t in_flight);   // TX stamps of that many probes are kept
+    socket_t get_fd() const;
+private:
+    enum TimestampMode { TS_USER, TS_RX, TS_KERNEL };
+    struct TxStamp{
+        uint32_t tx_id;
+        int64_t ts;     // nanoseconds
+    };
+    socket_t sockfd;
+    TimestampMode ts_mode;
+    uint32_t tx_counter;    // SOF_TIMESTAMPING_OPT_ID of next send
+    std::vector<TxStamp> tx_stamps;
+
+    void enable_timestamps();
+    void drain_tx_stamps();
+    bool find_tx_stamp(uint32_t tx_id, int64_t& ts);
+};
+
+
 class PingRes {
 public:
     int rtt; // microseconds
+    int64_t rtt_ns;
     bool bad_checksum;
     PingRes(int _rtt=-1, bool _checksum=false);
+    static PingRes from_ns(int64_t _rtt_ns, bool _checksum=false);
 };
 
 
-// Process ping results (microseconds resolution)
+// Process ping results (getters in microseconds, kept internally without truncation)
 class PingStat{
 public:
     PingStat();
-    void process_ping_res(const PingRes& res, int seq, bool verbose=true);
+    // now: monotonic_ns of result, -1 - current time
+    void process_ping_res(const PingRes& res, int seq, bool verbose=true, int64_t now=-1);
     void print_statistics() const;
     int get_last_rtt() const;
     int get_srtt() const;
     int get_jitter() const;
+    int get_rtt_percentile(double percentile, bool lifetime=false) const;
+    int get_max_rtt(bool lifetime=false) const;
+    const LogLinearHistogram& get_rtt_histogram(bool lifetime=false) const;   // nanoseconds
     double get_loss() const;
 private:
-    int srtt;   // smoothed_rtt
-    int jitter;
+    double srtt;    // smoothed_rtt
+    double jitter;
     int lost;
     int total;
 
-    int curr_rtt;
-    int prev_rtt;
+    double curr_rtt;
+    double prev_rtt;
+
+    // constant memory RTT distribution: lifetime and sliding window of time slices
+    LogLinearHistogram rtt_lifetime;
+    std::vector<LogLinearHistogram> rtt_window;
+    int64_t curr_slice;     // index of current slice since monotonic clock epoch
+    mutable LogLinearHistogram rtt_window_merged;
+    mutable bool window_dirty;
+
     void update_jitter();
     void update_srtt();
+    void update_quantiles(int64_t rtt_ns, int64_t now);
 };
 
 
@@ -81,35 +188,103 @@ public:
                     int _ping_timeout=DEFAULT_PING_TIMEOUT);
     Pinger(const Pinger& other) = delete;
     Pinger& operator=(const Pinger& other) = delete;
-    Pinger(Pinger&&);
-    Pinger& operator=(Pinger&& other);
-    virtual ~Pinger();
+    Pinger(Pinger&&) = default;
+    Pinger& operator=(Pinger&& other) = default;
+    virtual ~Pinger() = default;
 
     PingRes ping(int seq=0, int id=-1);     // return rtt in microseconds
+    // ping 'count' sequence numbers starting from first_seq with 'gap' (microseconds) between probes
+    virtual std::vector<PingRes> ping_series(int first_seq, int count, int gap, int id=-1);
+    // send 'count' probes back-to-back, result per probe in sequence order
+    std::vector<PingRes> ping_burst(int first_seq, int count, int id=-1);
+    virtual int get_window() const;         // max probes in flight
+    unsigned get_duplicates() const;
+    unsigned get_reordered() const;
     std::string get_hostname() const;
     void print_host() const;
     virtual std::unique_ptr<Pinger> to_unique_ptr();
-private:
+
+    /* Non-blocking series for external event loop: after start_series() call series_step()
+     * at returned wakeup time and series_on_readable() when socket is readable, until
+     * series_step() returns -1. Up to 'window' probes are in flight (0 - get_window()),
+     * probes due at once (gap 0) leave in one sendmmsg.
+     */
+    void start_series(int first_seq, int count, int gap, int id=-1, int window=0);
+    int64_t series_step();      // sends and expires due probes; next wakeup (timer_clock_ns), -1 when done
+    void series_on_readable();  // drains socket, replies to other probes are dropped
+    const std::vector<PingRes>& get_series_results() const;     // result per probe, lost by default
+    socket_t get_fd() const;
+protected:
+    struct ProbeSlot{
+        int seq;
+        int res_idx;            // index in current series results
+        ProbeSendInfo sent;
+        int64_t expire_time;    // timer clock, nanoseconds
+        bool outstanding;
+        bool answered;
+    };
+    struct Series{
+        int first_seq;
+        int count;
+        int64_t gap;            // nanoseconds
+        int id;
+        int window;
+        int next;               // next probe to send (index in series)
+        int oldest;             // oldest probe that may still wait for reply
+        int outstanding;
+        int highest_seq;
+        int64_t start_time;     // timer clock, nanoseconds
+        int64_t next_send_time; // timer clock, nanoseconds
+        bool active;
+        std::vector<PingRes> results;
+    };
     std::string hostname;
     int ping_timeout;   // after that packet is considered lost
 
-    socket_t sockfd;
+    IcmpSocket sock;
     struct sockaddr_storage addr;
     socklen_t dst_addr_len;
-    void make_socket(struct addrinfo* addrinfo_list);
+    unsigned n_duplicates;
+    unsigned n_reordered;
+    Series series;
+    std::vector<ProbeSlot> slots;   // ring indexed by seq, never smaller than series window
+    unsigned slot_mask;
+    std::vector<ProbeSendInfo> burst_sent;
+
+    ProbeSendInfo send_echo(int seq, int id);
+    void process_reply(const EchoReply& reply);
+private:
     void set_addr(struct addrinfo* adrrinfo);
 };
 
 
+// gap must be positive, probe older than 65536 gaps is counted lost even before timeout
 class ContinuosPinger: public Pinger{
 public:
     explicit ContinuosPinger(const char* _hostname, int _ping_gap=DEFAULT_PING_GAP,
                              int _ping_timeout=DEFAULT_PING_TIMEOUT);
     void ping_continuously();
     int get_ping_gap() const;
+    const LogLinearHistogram& get_send_lateness() const;    // nanoseconds
     virtual std::unique_ptr<Pinger> to_unique_ptr() override;
 private:
     int ping_gap;
+    LogLinearHistogram send_lateness;   // actual send time minus grid point
+};
+
+
+/* Keeps up to 'window' echo requests in flight. Replies are matched to requests
+ * in O(1) by sequence number through a ring of probe slots.
+ */
+class PipelinedPinger: public Pinger{
+public:
+    explicit PipelinedPinger(const char* _hostname, int _window=DEFAULT_PING_WINDOW,
+                             int _ping_timeout=DEFAULT_PING_TIMEOUT);
+    virtual std::vector<PingRes> ping_series(int first_seq, int count, int gap, int id=-1) override;
+    virtual int get_window() const override;
+    virtual std::unique_ptr<Pinger> to_unique_ptr() override;
+private:
+    int window;
 };
 
 
@@ -0,0 +1,129 @@
+// Converts binary ChEst record stream (launch_chest -B) to yaml or csv.
+
+#include "../chest_record.h"
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+void usage(const char *proggie)
+{
+    std::cerr << "usage: " << proggie << " [-c] [<filename>]" << std::endl;
+    std::cerr << "      reads stdin if no file given" << std::endl;
+    std::cerr << "      -c         csv output (default: yaml)" << std::endl;
+}
+
+
+// "sec.msec" from microseconds
+static std::string format_time(int64_t time){
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld.%03lld", (long long)(time / 1000000), (long long)(time % 1000000 / 1000));
+    return buf;
+}
+
+
+// same fields and units as yaml output of ChestSender
+static void print_yaml(const ChestSnapshot& snapshot, const std::string& tag){
+    std::cout << "-   runnum    : " << snapshot.runnum << '\n';
+    if (!tag.empty()){
+        std::cout << "    peer      : " << tag << '\n';
+    }
+    std::cout << "    time      : " << format_time(snapshot.time) << '\n';
+    std::cout << "    abw       : " << snapshot.abw / 1000000.0  << '\n';
+    std::cout << "    lastRtt   : " << snapshot.last_rtt / 1000. << '\n';
+    std::cout << "    sRtt      : " << snapshot.srtt / 1000. << '\n';
+    std::cout << "    jitter    : " << snapshot.jitter / 1000. << '\n';
+    std::cout << "    rttP50    : " << snapshot.rtt_p50 / 1000. << '\n';
+    std::cout << "    rttP90    : " << snapshot.rtt_p90 / 1000. << '\n';
+    std::cout << "    rttP99    : " << snapshot.rtt_p99 / 1000. << '\n';
+    std::cout << "    rttMax    : " << snapshot.rtt_max / 1000. << '\n';
+    std::cout << "    loss_total: " << snapshot.loss_total << '\n';
+    if (snapshot.loss_local >= 0){
+        std::cout << "    loss_local: " << snapshot.loss_local << '\n';
+    } else {
+        std::cout << "    loss_local: null\n";
+    }
+    std::cout << "    gap_ms    : " << snapshot.gap / 1000. << '\n';
+    std::cout << "    budget    : " << snapshot.budget_level << '\n';
+    std::cout << "    pings_skipped: " << snapshot.pings_skipped << '\n';
+    std::cout << "    overhead_mbit: " << snapshot.overhead / 1000000.0 << '\n';
+    std::cout << "    ping_dup  : " << snapshot.ping_dup << '\n';
+    std::cout << "    ping_reord: " << snapshot.ping_reord << '\n';
+    std::cout << "    round_time: " << format_time(snapshot.round_time) << '\n';
+    std::cout << '\n';
+}
+
+
+static void print_csv_header(){
+    std::cout << "peer,runnum,time,abw,lastRtt,sRtt,jitter,rttP50,rttP90,rttP99,rttMax,"
+                 "loss_total,loss_local,gap_ms,budget,pings_skipped,overhead_mbit,ping_dup,ping_reord,round_time\n";
+}
+
+
+static void print_csv(const ChestSnapshot& snapshot, const std::string& tag){
+    std::cout << tag << ',' << snapshot.runnum << ',' << format_time(snapshot.time) << ','
+              << snapshot.abw / 1000000.0 << ',' << snapshot.last_rtt / 1000. << ','
+              << snapshot.srtt / 1000. << ',' << snapshot.jitter / 1000. << ','
+              << snapshot.rtt_p50 / 1000. << ',' << snapshot.rtt_p90 / 1000. << ','
+              << snapshot.rtt_p99 / 1000. << ',' << snapshot.rtt_max / 1000. << ','
+              << snapshot.loss_total << ',';
+    if (snapshot.loss_local >= 0){
+        std::cout << snapshot.loss_local;
+    }
+    std::cout << ',' << snapshot.gap / 1000. << ',' << snapshot.budget_level << ',' << snapshot.pings_skipped;
+    std::cout << ',' << snapshot.overhead / 1000000.0 << ','
+              << snapshot.ping_dup << ',' << snapshot.ping_reord << ','
+              << format_time(snapshot.round_time) << '\n';
+}
+
+
+int main(int argc, char **argv)
+{
+    int c;
+    bool is_csv = false;
+    while ((c = getopt(argc, argv, "ch")) != EOF)
+    {
+        switch(c)
+        {
+        case 'c':
+            is_csv = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            exit (-1);
+        }
+    }
+
+    std::ifstream fin;
+    std::istream* in = &std::cin;
+    if (optind < argc){
+        fin.open(argv[optind], std::ios::binary);
+        if (!fin.is_open()){
+            std::cerr << "Failed to open file " << argv[optind] << std::endl;
+            return 1;
+        }
+        in = &fin;
+    }
+
+    try{
+        decode_stream_header(*in);
+        if (is_csv){
+            print_csv_header();
+        }
+        ChestSnapshot snapshot;
+        std::string tag;
+        while (decode_record(*in, snapshot, tag)){
+            if (is_csv){
+                print_csv(snapshot, tag);
+            } else {
+                print_yaml(snapshot, tag);
+            }
+        }
+    } catch (std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
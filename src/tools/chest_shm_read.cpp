@@ -0,0 +1,77 @@
+// Prints snapshots published by launch_chest -M <name>.
+
+#include "../chest_shm.h"
+#include <iostream>
+#include <unistd.h>
+
+void usage(const char *proggie)
+{
+    std::cerr << "usage: " << proggie << " [-i <int>] <name>" << std::endl;
+    std::cerr << "      reads /dev/shm/<name>, for many receivers name is <name>.<dest addr>" << std::endl;
+    std::cerr << "      -i <int>   poll every <int> milliseconds and print new snapshots (default: print once)" << std::endl;
+}
+
+
+static void print_snapshot(const ChestSnapshot& snapshot){
+    std::cout << "-   runnum    : " << snapshot.runnum << '\n';
+    std::cout << "    time      : " << snapshot.time / 1000000. << '\n';
+    std::cout << "    abw       : " << snapshot.abw / 1000000.0 << '\n';
+    std::cout << "    sRtt      : " << snapshot.srtt / 1000. << '\n';
+    std::cout << "    jitter    : " << snapshot.jitter / 1000. << '\n';
+    std::cout << "    loss_total: " << snapshot.loss_total << '\n';
+    if (snapshot.loss_local >= 0){
+        std::cout << "    loss_local: " << snapshot.loss_local << '\n';
+    } else {
+        std::cout << "    loss_local: null\n";
+    }
+    std::cout << "    gap_ms    : " << snapshot.gap / 1000. << '\n';
+    std::cout << "    budget    : " << snapshot.budget_level << '\n';
+    std::cout << "    overhead_mbit: " << snapshot.overhead / 1000000.0 << '\n';
+    std::cout << "    round_time: " << snapshot.round_time / 1000000. << '\n';
+    std::cout << std::endl;
+}
+
+
+int main(int argc, char **argv)
+{
+    int c;
+    int interval = -1;  // microseconds
+    while ((c = getopt(argc, argv, "i:h")) != EOF)
+    {
+        switch(c)
+        {
+        case 'i':
+            interval = atoi(optarg) * 1000;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            exit (-1);
+        }
+    }
+    if (optind >= argc){
+        usage(argv[0]);
+        exit (-1);
+    }
+
+    try{
+        ChestShmReader reader(argv[optind]);
+        uint64_t version = 0;
+        do {
+            uint64_t curr_version = reader.get_version();
+            if (curr_version != version){   // nothing is printed before first round
+                version = curr_version;
+                print_snapshot(reader.load());
+            }
+            if (interval > 0){
+                usleep(interval);
+            }
+        } while (interval > 0);
+    } catch (std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
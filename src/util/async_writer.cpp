@@ -0,0 +1,110 @@
+#include "async_writer.h"
+#include "event_loop.h"
+#include <algorithm>
+#include <chrono>
+
+
+static size_t round_up_pow2(size_t n){
+    size_t res = 1;
+    while (res < n){
+        res <<= 1;
+    }
+    return res;
+}
+
+
+AsyncWriter::AsyncWriter(std::ostream& out, int flush_interval, OverflowPolicy policy, size_t capacity):
+m_out(out), m_flush_interval(std::max(flush_interval, MIN_WRITER_FLUSH_INTERVAL)), m_policy(policy),
+m_ring(round_up_pow2(capacity)), m_mask(m_ring.size() - 1), m_head(0), m_tail(0), m_dropped(0),
+m_high_water(std::max<size_t>(m_ring.size() / 2, 1)), m_stopped(false), m_full_waiting(false)
+{
+    m_thread = std::thread(&AsyncWriter::run, this);
+}
+
+
+AsyncWriter::~AsyncWriter(){
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopped = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+}
+
+
+// lock-free unless queue reaches high water or is full
+bool AsyncWriter::write(std::string&& record){
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) > m_mask){
+        if (m_policy == DROP_NEWEST){
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        wait_for_space(head);
+    }
+    m_ring[head & m_mask] = std::move(record);
+    m_head.store(head + 1, std::memory_order_release);
+    if (head + 1 - m_tail.load(std::memory_order_acquire) == m_high_water){
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cv.notify_one();
+    }
+    return true;
+}
+
+
+void AsyncWriter::wait_for_space(size_t head){
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_full_waiting = true;
+    m_cv.notify_one();
+    m_space_cv.wait(lock, [this, head](){ return head - m_tail.load(std::memory_order_acquire) <= m_mask; });
+    m_full_waiting = false;
+}
+
+
+size_t AsyncWriter::get_queued() const{
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+}
+
+
+uint64_t AsyncWriter::get_dropped() const{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+
+// appends queued records to batch, returns their number
+size_t AsyncWriter::drain(std::string& batch){
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+    for (size_t i = tail; i != head; i++){
+        batch += m_ring[i & m_mask];
+        std::string().swap(m_ring[i & m_mask]);    // free here, producer moves next record into empty slot
+    }
+    m_tail.store(head, std::memory_order_release);
+    return head - tail;
+}
+
+
+void AsyncWriter::run(){
+    block_all_signals();    // SIGINT is for measurement loop
+    std::string batch;
+    bool stopped = false;
+    while (!stopped){
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cv.wait_for(lock, std::chrono::microseconds(m_flush_interval),
+                          [this](){ return m_stopped || get_queued() >= m_high_water; });
+            stopped = m_stopped;
+        }
+        if (drain(batch) != 0){     // after stop: everything written before destructor
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_full_waiting){
+                m_space_cv.notify_one();
+            }
+        }
+        if (!batch.empty()){
+            m_out.write(batch.data(), batch.size());
+            m_out.flush();
+            batch.clear();
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __AsyncWriter__
+#define __AsyncWriter__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// records
+#define DEFAULT_WRITER_CAPACITY 256
+// microseconds
+#define DEFAULT_WRITER_FLUSH_INTERVAL 1000000
+#define MIN_WRITER_FLUSH_INTERVAL 1000
+
+
+/* Moves output off measurement threads: records go through bounded lock-free
+ * single-producer queue to background thread, which writes them in batches
+ * and flushes the stream once per flush interval (at least MIN_WRITER_FLUSH_INTERVAL).
+ * Producer wakes it earlier when queue fills to half, and waits on full queue with BLOCK.
+ * Several producers must serialize write() calls themselves.
+ */
+class AsyncWriter{
+public:
+    enum OverflowPolicy{
+        BLOCK,          // producer waits for free slot
+        DROP_NEWEST     // record is discarded and counted
+    };
+    explicit AsyncWriter(std::ostream& out, int flush_interval=DEFAULT_WRITER_FLUSH_INTERVAL,
+                         OverflowPolicy policy=BLOCK, size_t capacity=DEFAULT_WRITER_CAPACITY);
+    AsyncWriter(const AsyncWriter& other) = delete;
+    AsyncWriter& operator=(const AsyncWriter& other) = delete;
+    ~AsyncWriter();     // writes everything queued
+
+    bool write(std::string&& record);   // false if record was dropped
+    uint64_t get_dropped() const;
+private:
+    std::ostream& m_out;
+    int m_flush_interval;   // microseconds
+    OverflowPolicy m_policy;
+    std::vector<std::string> m_ring;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_head;     // next slot to fill, producer
+    alignas(64) std::atomic<size_t> m_tail;     // next slot to take, consumer
+    std::atomic<uint64_t> m_dropped;
+    size_t m_high_water;    // queued records which wake consumer
+    bool m_stopped;
+    bool m_full_waiting;    // producer waits for free slot
+    std::mutex m_lock;      // for wakeups only, producer takes it at high water or on full queue
+    std::condition_variable m_cv;           // consumer
+    std::condition_variable m_space_cv;     // producer
+    std::thread m_thread;
+
+    void run();
+    size_t drain(std::string& batch);
+    size_t get_queued() const;
+    void wait_for_space(size_t head);
+};
+
+#endif
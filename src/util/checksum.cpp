@@ -0,0 +1,129 @@
+#include "checksum.h"
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+
+/* One's complement sum of 16-bit words equals folded sum of 32-bit words
+ * (2^16 = 1 mod 2^16-1), so kernels add native-endian 32-bit words into
+ * 64-bit accumulators and fold once at the end.
+ */
+
+uint16_t checksum_fold(uint64_t sum){
+    while ((sum >> 16) != 0){
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+
+uint64_t checksum_partial_scalar(const uint8_t* buf, size_t size){
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, buf + i, sizeof(word));   // unaligned-safe load
+        sum += (word & 0xffffffff) + (word >> 32);
+    }
+    for (; i + 2 <= size; i += 2){
+        uint16_t word;
+        memcpy(&word, buf + i, sizeof(word));
+        sum += word;
+    }
+    if (i < size){
+        // odd byte is padded with zero byte on the right
+        uint8_t last[2] = { buf[i], 0 };
+        uint16_t word;
+        memcpy(&word, last, sizeof(word));
+        sum += word;
+    }
+    return sum;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static uint64_t hsum_epi64(__m128i v){
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+
+__attribute__((target("sse2")))
+uint64_t checksum_partial_sse2(const uint8_t* buf, size_t size){
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    // 32-bit lanes widened to 64 bits, can't overflow for any packet size
+    for (; i + 16 <= size; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+    }
+    return hsum_epi64(acc) + checksum_partial_scalar(buf + i, size - i);
+}
+
+
+__attribute__((target("avx2")))
+uint64_t checksum_partial_avx2(const uint8_t* buf, size_t size){
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64){
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(buf + i + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+    }
+    for (; i + 32 <= size; i += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(buf + i));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    }
+    __m256i acc = _mm256_add_epi64(acc0, acc1);
+    __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return hsum_epi64(acc128) + checksum_partial_scalar(buf + i, size - i);
+}
+
+#endif
+
+
+using checksum_kernel = uint64_t (*)(const uint8_t*, size_t);
+
+struct KernelChoice{
+    checksum_kernel kernel;
+    const char* name;
+};
+
+static KernelChoice choose_kernel(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        return KernelChoice{checksum_partial_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")){
+        return KernelChoice{checksum_partial_sse2, "sse2"};
+    }
+#endif
+    return KernelChoice{checksum_partial_scalar, "scalar"};
+}
+
+static const KernelChoice& get_kernel(){
+    static const KernelChoice choice = choose_kernel();
+    return choice;
+}
+
+
+uint16_t compute_checksum(const void* buf, size_t size){
+    /* RFC 1071 - http://tools.ietf.org/html/rfc1071 */
+    return (uint16_t)~checksum_fold(get_kernel().kernel((const uint8_t*)buf, size));
+}
+
+
+const char* checksum_kernel_name(){
+    return get_kernel().name;
+}
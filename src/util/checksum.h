@@ -0,0 +1,24 @@
+#ifndef __Checksum__
+#define __Checksum__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Internet checksum (RFC 1071) for any length and alignment.
+ * Result is in network byte order as stored in packet header.
+ * Kernel (scalar, SSE2 or AVX2) is chosen once at runtime by CPU features.
+ */
+uint16_t compute_checksum(const void* buf, size_t size);
+
+// Kernels, exposed for benchmarks; all return unfolded partial sum
+uint64_t checksum_partial_scalar(const uint8_t* buf, size_t size);
+#if defined(__x86_64__) || defined(__i386__)
+uint64_t checksum_partial_sse2(const uint8_t* buf, size_t size);
+uint64_t checksum_partial_avx2(const uint8_t* buf, size_t size);
+#endif
+
+uint16_t checksum_fold(uint64_t sum);
+
+const char* checksum_kernel_name();
+
+#endif
@@ -0,0 +1,92 @@
+#include "clock.h"
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+    #include <cpuid.h>
+    #include <x86intrin.h>
+#endif
+
+static int64_t clock_ns(clockid_t clock_id){
+    struct timespec now;
+    clock_gettime(clock_id, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+namespace tsc_clock{
+    bool enabled = false;
+    uint64_t base_tsc;
+    int64_t base_ns;
+    uint64_t mult;      // nanoseconds per tick, 32.32 fixed point
+}
+
+
+#if defined(__x86_64__)
+static bool has_invariant_tsc(){
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)){
+        return false;
+    }
+    return (edx & (1u << 8)) != 0;
+}
+#endif
+
+
+int64_t monotonic_ns(){
+#if defined(__x86_64__)
+    if (tsc_clock::enabled){
+        unsigned __int128 delta = __rdtsc() - tsc_clock::base_tsc;
+        return tsc_clock::base_ns + (int64_t)((delta * tsc_clock::mult) >> 32);
+    }
+#endif
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+
+int64_t monotonic_us(){
+    return monotonic_ns() / 1000;
+}
+
+
+int64_t timer_clock_ns(){
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+
+int64_t timer_clock_us(){
+    return timer_clock_ns() / 1000;
+}
+
+
+int64_t realtime_ns(){
+    return clock_ns(CLOCK_REALTIME);
+}
+
+
+bool clock_use_tsc(int calibration_time){
+#if defined(__x86_64__)
+    if (!has_invariant_tsc()){
+        return false;
+    }
+    int64_t start_ns = clock_ns(CLOCK_MONOTONIC);
+    uint64_t start_tsc = __rdtsc();
+    usleep(calibration_time);
+    int64_t end_ns = clock_ns(CLOCK_MONOTONIC);
+    uint64_t end_tsc = __rdtsc();
+    if (end_tsc <= start_tsc || end_ns <= start_ns){
+        return false;
+    }
+    tsc_clock::mult = (uint64_t)(((unsigned __int128)(end_ns - start_ns) << 32) / (end_tsc - start_tsc));
+    tsc_clock::base_tsc = end_tsc;
+    tsc_clock::base_ns = end_ns;
+    tsc_clock::enabled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+const char* clock_source_name(){
+    return tsc_clock::enabled ? "tsc" : "clock_monotonic";
+}
@@ -0,0 +1,27 @@
+#ifndef __Clock__
+#define __Clock__
+
+#include <stdint.h>
+
+/* Single time base of the tool: CLOCK_MONOTONIC in nanoseconds, immune to NTP steps.
+ * Optional TSC fast path (clock_use_tsc) is calibrated against CLOCK_MONOTONIC once
+ * and used only on CPUs with invariant TSC. It isn't slewed by NTP as CLOCK_MONOTONIC is,
+ * so monotonic_ns() is for intervals (RTT, durations) only.
+ */
+int64_t monotonic_ns();
+int64_t monotonic_us();
+
+/* CLOCK_MONOTONIC read directly, time base of timerfd and absolute deadlines.
+ * Anything scheduled (send grids, timer deadlines, pauses) uses it, even with TSC on.
+ */
+int64_t timer_clock_ns();
+int64_t timer_clock_us();
+
+// CLOCK_REALTIME, only for pairing with kernel socket timestamps
+int64_t realtime_ns();
+
+// calibrate and switch monotonic_ns() to TSC, returns false if unsupported
+bool clock_use_tsc(int calibration_time=20000);     // microseconds
+const char* clock_source_name();
+
+#endif
@@ -0,0 +1,193 @@
+#include "event_loop.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/////////////////////////// EventLoop
+EventLoop::EventLoop(): m_stopped(false){
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0){
+        throw std::runtime_error(std::string("epoll_create1: ") + strerror(errno));
+    }
+}
+
+
+EventLoop::~EventLoop(){
+    close(m_epoll_fd);
+}
+
+
+void EventLoop::add_fd(int fd, Callback on_readable){
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0){
+        throw std::runtime_error(std::string("epoll_ctl: ") + strerror(errno));
+    }
+    m_callbacks[fd] = std::move(on_readable);
+}
+
+
+void EventLoop::remove_fd(int fd){
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    m_callbacks.erase(fd);
+}
+
+
+void EventLoop::run(){
+    struct epoll_event events[EVENT_LOOP_BATCH];
+    m_stopped = false;
+    while (!m_stopped){
+        int nevents = epoll_wait(m_epoll_fd, events, EVENT_LOOP_BATCH, -1);
+        if (nevents < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            throw std::runtime_error(std::string("epoll_wait: ") + strerror(errno));
+        }
+        for (int i = 0; i < nevents && !m_stopped; i++){
+            auto it = m_callbacks.find(events[i].data.fd);
+            if (it != m_callbacks.end()){
+                it->second();
+            }
+        }
+    }
+}
+
+
+void EventLoop::stop(){
+    m_stopped = true;
+}
+
+
+/////////////////////////// TimerFd
+TimerFd::TimerFd(){
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_fd < 0){
+        throw std::runtime_error(std::string("timerfd_create: ") + strerror(errno));
+    }
+}
+
+
+TimerFd::~TimerFd(){
+    close(m_fd);
+}
+
+
+void TimerFd::arm_at(int64_t deadline){
+    if (deadline < 1){
+        deadline = 1;   // zero would disarm
+    }
+    struct itimerspec spec = {{0, 0}, {(time_t)(deadline / 1000000000), (long)(deadline % 1000000000)}};
+    if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0){
+        throw std::runtime_error(std::string("timerfd_settime: ") + strerror(errno));
+    }
+}
+
+
+void TimerFd::disarm(){
+    struct itimerspec spec = {{0, 0}, {0, 0}};
+    timerfd_settime(m_fd, 0, &spec, NULL);
+}
+
+
+bool TimerFd::consume(){
+    uint64_t expirations = 0;
+    return read(m_fd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0;
+}
+
+
+int TimerFd::get_fd() const{
+    return m_fd;
+}
+
+
+/////////////////////////// EventFd
+EventFd::EventFd(){
+    m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_fd < 0){
+        throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+    }
+}
+
+
+EventFd::~EventFd(){
+    close(m_fd);
+}
+
+
+void EventFd::notify(){
+    uint64_t one = 1;
+    if (write(m_fd, &one, sizeof(one)) != sizeof(one)){
+        perror("eventfd write");
+    }
+}
+
+
+uint64_t EventFd::consume(){
+    uint64_t count = 0;
+    if (read(m_fd, &count, sizeof(count)) != sizeof(count)){
+        return 0;
+    }
+    return count;
+}
+
+
+int EventFd::get_fd() const{
+    return m_fd;
+}
+
+
+/////////////////////////// SignalFd
+SignalFd::SignalFd(std::initializer_list<int> signals){
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int signo: signals){
+        sigaddset(&mask, signo);
+    }
+    if (pthread_sigmask(SIG_BLOCK, &mask, &m_prev_mask) != 0){
+        throw std::runtime_error("Failed to block signals");
+    }
+    m_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_fd < 0){
+        int error = errno;
+        pthread_sigmask(SIG_SETMASK, &m_prev_mask, NULL);
+        throw std::runtime_error(std::string("signalfd: ") + strerror(error));
+    }
+}
+
+
+SignalFd::~SignalFd(){
+    while (consume() != 0) {}   // pending ones would be delivered on unblock
+    close(m_fd);
+    pthread_sigmask(SIG_SETMASK, &m_prev_mask, NULL);
+}
+
+
+int SignalFd::consume(){
+    struct signalfd_siginfo info;
+    if (read(m_fd, &info, sizeof(info)) != sizeof(info)){
+        return 0;
+    }
+    return info.ssi_signo;
+}
+
+
+int SignalFd::get_fd() const{
+    return m_fd;
+}
+
+
+void block_all_signals(){
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
@@ -0,0 +1,89 @@
+#ifndef __EventLoop__
+#define __EventLoop__
+
+#include <functional>
+#include <initializer_list>
+#include <signal.h>
+#include <stdint.h>
+#include <unordered_map>
+
+// epoll events handled per epoll_wait
+#define EVENT_LOOP_BATCH 16
+
+
+/* Single-threaded epoll reactor: callbacks run in the thread calling run().
+ * Sources are level-triggered, callback must consume what made fd readable.
+ */
+class EventLoop{
+public:
+    typedef std::function<void()> Callback;
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void add_fd(int fd, Callback on_readable);
+    void remove_fd(int fd);
+    void run();     // until stop() is called from callback
+    void stop();
+private:
+    int m_epoll_fd;
+    bool m_stopped;
+    std::unordered_map<int, Callback> m_callbacks;
+};
+
+
+// One-shot timer on absolute CLOCK_MONOTONIC time (base of timer_clock_ns, not of TSC monotonic_ns)
+class TimerFd{
+public:
+    TimerFd();
+    ~TimerFd();
+    TimerFd(const TimerFd&) = delete;
+    TimerFd& operator=(const TimerFd&) = delete;
+
+    void arm_at(int64_t deadline);  // timer clock nanoseconds, past deadline fires at once
+    void disarm();
+    bool consume();                 // true if timer has fired since last call
+    int get_fd() const;
+private:
+    int m_fd;
+};
+
+
+// Wakeup from other threads
+class EventFd{
+public:
+    EventFd();
+    ~EventFd();
+    EventFd(const EventFd&) = delete;
+    EventFd& operator=(const EventFd&) = delete;
+
+    void notify();
+    uint64_t consume();     // notifications since last call
+    int get_fd() const;
+private:
+    int m_fd;
+};
+
+
+/* Signals as readable fd. Signals are blocked in calling thread for object lifetime,
+ * threads started meanwhile inherit the mask; previous mask is restored in destructor.
+ */
+class SignalFd{
+public:
+    SignalFd(std::initializer_list<int> signals);
+    ~SignalFd();
+    SignalFd(const SignalFd&) = delete;
+    SignalFd& operator=(const SignalFd&) = delete;
+
+    int consume();          // next pending signal, 0 if none
+    int get_fd() const;
+private:
+    int m_fd;
+    sigset_t m_prev_mask;
+};
+
+// for helper threads: signals go to threads that handle them
+void block_all_signals();
+
+#endif
@@ -0,0 +1,105 @@
+#include "histogram.h"
+#include <algorithm>
+
+LogLinearHistogram::LogLinearHistogram(int sub_bucket_bits, int max_value_bits):
+sub_bits(sub_bucket_bits),
+buckets((max_value_bits - sub_bucket_bits + 2) << (sub_bucket_bits - 1), 0),
+count(0), min(0), max(0), sum(0) {};
+
+
+size_t LogLinearHistogram::bucket_index(uint64_t value) const{
+    if (value < (1ULL << sub_bits)){
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - sub_bits + 1;
+    size_t idx = ((size_t)shift << (sub_bits - 1)) + (value >> shift);
+    return std::min(idx, buckets.size() - 1);
+}
+
+
+int64_t LogLinearHistogram::bucket_upper_bound(size_t idx) const{
+    if (idx < (1ULL << sub_bits)){
+        return idx;
+    }
+    int shift = (idx >> (sub_bits - 1)) - 1;
+    uint64_t mantissa = idx - ((size_t)shift << (sub_bits - 1));
+    return (int64_t)(((mantissa + 1) << shift) - 1);
+}
+
+
+void LogLinearHistogram::record(int64_t value, uint64_t n){
+    if (value < 0){
+        value = 0;
+    }
+    buckets[bucket_index(value)] += n;
+    if (count == 0 || value < min){
+        min = value;
+    }
+    if (count == 0 || value > max){
+        max = value;
+    }
+    count += n;
+    sum += (double)value * n;
+}
+
+
+void LogLinearHistogram::merge(const LogLinearHistogram& other){
+    if (other.count == 0){
+        return;
+    }
+    for (size_t i = 0; i < buckets.size() && i < other.buckets.size(); i++){
+        buckets[i] += other.buckets[i];
+    }
+    min = count == 0 ? other.min : std::min(min, other.min);
+    max = count == 0 ? other.max : std::max(max, other.max);
+    count += other.count;
+    sum += other.sum;
+}
+
+
+void LogLinearHistogram::reset(){
+    std::fill(buckets.begin(), buckets.end(), 0);
+    count = 0;
+    min = max = 0;
+    sum = 0;
+}
+
+
+uint64_t LogLinearHistogram::get_count() const{
+    return count;
+}
+
+int64_t LogLinearHistogram::get_min() const{
+    return min;
+}
+
+int64_t LogLinearHistogram::get_max() const{
+    return max;
+}
+
+double LogLinearHistogram::get_mean() const{
+    return count == 0 ? 0 : sum / count;
+}
+
+
+// upper bound of bucket holding the percentile, clamped to observed range;
+// last bucket also holds clamped values, its bound is max
+int64_t LogLinearHistogram::get_percentile(double percentile) const{
+    if (count == 0){
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100. * count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++){
+        seen += buckets[i];
+        if (seen >= rank){
+            if (i == buckets.size() - 1){
+                return max;
+            }
+            return std::max(min, std::min(max, bucket_upper_bound(i)));
+        }
+    }
+    return max;
+}
@@ -0,0 +1,44 @@
+#ifndef __Histogram__
+#define __Histogram__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// relative bucket precision is 2^-(sub_bucket_bits-1)
+#define DEFAULT_SUB_BUCKET_BITS 5
+// values up to 2^max_value_bits are kept exactly in bucket range, bigger are clamped
+#define DEFAULT_MAX_VALUE_BITS 40
+
+
+/* Log-linear (HDR-like) histogram of non-negative integer values.
+ * Values below 2^sub_bucket_bits get own bucket, above that every power of two
+ * is split into 2^(sub_bucket_bits-1) linear sub-buckets.
+ * Recording is O(1) and never allocates; memory is fixed by constructor arguments.
+ */
+class LogLinearHistogram{
+public:
+    explicit LogLinearHistogram(int sub_bucket_bits=DEFAULT_SUB_BUCKET_BITS,
+                                int max_value_bits=DEFAULT_MAX_VALUE_BITS);
+    void record(int64_t value, uint64_t count=1);
+    void merge(const LogLinearHistogram& other);    // other must have same layout
+    void reset();
+
+    uint64_t get_count() const;
+    int64_t get_min() const;
+    int64_t get_max() const;
+    double get_mean() const;
+    int64_t get_percentile(double percentile) const;    // percentile in [0, 100]
+private:
+    int sub_bits;
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    int64_t min;
+    int64_t max;
+    double sum;
+
+    size_t bucket_index(uint64_t value) const;
+    int64_t bucket_upper_bound(size_t idx) const;
+};
+
+#endif
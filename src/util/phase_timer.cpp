@@ -0,0 +1,90 @@
+#include "phase_timer.h"
+#include <mutex>
+#include <stdio.h>
+
+namespace phase_timers{
+    std::atomic<bool> enabled(false);
+    std::atomic<bool> dump_requested(false);
+
+    // phases are recorded from ping, abw and worker threads
+    struct PhaseStat{
+        std::mutex lock;
+        LogLinearHistogram hist;
+    };
+    PhaseStat stats[PHASE_COUNT];
+
+    const char* names[PHASE_COUNT] = {
+        "abw_measure",
+        "abw_process",
+        "ping",
+        "ping_series",
+        "loss_process",
+        "loss_local",
+        "output",
+    };
+
+    void record(Phase phase, int64_t duration){
+        if (duration < 0){
+            duration = 0;
+        }
+        std::lock_guard<std::mutex> lock(stats[phase].lock);
+        stats[phase].hist.record(duration);
+    }
+}
+
+
+const char* phase_name(Phase phase){
+    if (phase < 0 || phase >= PHASE_COUNT){
+        return "unknown";
+    }
+    return phase_timers::names[phase];
+}
+
+
+void phase_timers_enable(bool enable){
+    phase_timers::enabled.store(enable, std::memory_order_relaxed);
+}
+
+
+bool phase_timers_enabled(){
+    return phase_timers::enabled.load(std::memory_order_relaxed);
+}
+
+
+LogLinearHistogram get_phase_histogram(Phase phase){
+    std::lock_guard<std::mutex> lock(phase_timers::stats[phase].lock);
+    return phase_timers::stats[phase].hist;
+}
+
+
+void reset_phase_timers(){
+    for (auto& stat: phase_timers::stats){
+        std::lock_guard<std::mutex> lock(stat.lock);
+        stat.hist.reset();
+    }
+}
+
+
+void print_phase_timers(std::ostream& out, const char* indent){
+    char buf[160];
+    for (int i = 0; i < PHASE_COUNT; i++){
+        LogLinearHistogram hist = get_phase_histogram((Phase)i);
+        if (hist.get_count() == 0){
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s%-13s: {count: %llu, p50: %.3f, p99: %.3f, max: %.3f}\n",
+                 indent, phase_name((Phase)i), (unsigned long long)hist.get_count(),
+                 hist.get_percentile(50) / 1e6, hist.get_percentile(99) / 1e6, hist.get_max() / 1e6);
+        out << buf;
+    }
+}
+
+
+void request_phase_dump(int signo){
+    phase_timers::dump_requested.store(true, std::memory_order_relaxed);
+}
+
+
+bool take_phase_dump_request(){
+    return phase_timers::dump_requested.exchange(false, std::memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+#ifndef __PhaseTimer__
+#define __PhaseTimer__
+
+#include "histogram.h"
+#include "clock.h"
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+
+// Hot-path phases timed by ScopedPhaseTimer
+enum Phase{
+    PHASE_ABW_MEASURE,      // AbSender::doOneMeasurementRound
+    PHASE_ABW_PROCESS,      // AbSender::processOneRoundRes
+    PHASE_PING,             // Pinger::ping, one probe
+    PHASE_PING_SERIES,      // whole ping series or burst
+    PHASE_LOSS_PROCESS,     // LossElr::process_answer for abw round
+    PHASE_LOSS_LOCAL,       // LossElr::get_local_loss_percentage
+    PHASE_OUTPUT,           // formatting of one round record
+    PHASE_COUNT
+};
+
+const char* phase_name(Phase phase);
+
+namespace phase_timers{
+    extern std::atomic<bool> enabled;
+    void record(Phase phase, int64_t duration);    // nanoseconds
+}
+
+/* Timers are off by default, enabling is cheap to check in hot path
+ * (one relaxed load). Build without CHEST_PHASE_TIMERS removes them entirely.
+ */
+void phase_timers_enable(bool enable=true);
+bool phase_timers_enabled();
+LogLinearHistogram get_phase_histogram(Phase phase);    // copy, nanoseconds
+void reset_phase_timers();
+// yaml mapping of phases with count and latency percentiles (ms)
+void print_phase_timers(std::ostream& out, const char* indent="");
+
+// on-demand dump (SIGUSR1), flag is async-signal-safe
+void request_phase_dump(int signo=0);
+bool take_phase_dump_request();
+
+
+class ScopedPhaseTimer{
+public:
+    explicit ScopedPhaseTimer(Phase phase): m_phase(phase),
+    m_start(phase_timers::enabled.load(std::memory_order_relaxed) ? monotonic_ns() : -1) {};
+    ~ScopedPhaseTimer(){
+        if (m_start >= 0){
+            phase_timers::record(m_phase, monotonic_ns() - m_start);
+        }
+    }
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+private:
+    Phase m_phase;
+    int64_t m_start;    // -1 when timers were disabled at scope entry
+};
+
+
+#define PHASE_TIMER_CONCAT_(a, b) a##b
+#define PHASE_TIMER_CONCAT(a, b) PHASE_TIMER_CONCAT_(a, b)
+
+#ifdef CHEST_PHASE_TIMERS
+    // times rest of enclosing scope
+    #define PHASE_TIMER(phase) ScopedPhaseTimer PHASE_TIMER_CONCAT(phase_timer_, __LINE__)(phase)
+#else
+    #define PHASE_TIMER(phase) do {} while (0)
+#endif
+
+#endif
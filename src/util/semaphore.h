@@ -0,0 +1,53 @@
+#ifndef __Semaphore__
+#define __Semaphore__
+
+#include <condition_variable>
+#include <mutex>
+
+// Counting semaphore (std::counting_semaphore is C++20)
+class Semaphore{
+public:
+    explicit Semaphore(int count=1): m_count(count) {};
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    void acquire(){
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cv.wait(lock, [this](){ return m_count > 0; });
+        m_count -= 1;
+    }
+
+    void release(){
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_count += 1;
+        }
+        m_cv.notify_one();
+    }
+private:
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    int m_count;
+};
+
+
+// Holds semaphore for scope, nullptr means no limit
+class SemaphoreGuard{
+public:
+    explicit SemaphoreGuard(Semaphore* sem): m_sem(sem){
+        if (m_sem){
+            m_sem->acquire();
+        }
+    }
+    SemaphoreGuard(const SemaphoreGuard&) = delete;
+    SemaphoreGuard& operator=(const SemaphoreGuard&) = delete;
+    ~SemaphoreGuard(){
+        if (m_sem){
+            m_sem->release();
+        }
+    }
+private:
+    Semaphore* m_sem;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __SeqLock__
+#define __SeqLock__
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+/* Sequence lock for single writer and any number of readers.
+ * Writer never waits; readers retry while a store is in progress.
+ * Value is kept in atomic words, so there is no data race on the payload,
+ * and layout is address-free (can live in shared memory).
+ */
+template<typename T>
+class SeqLock{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock value must be trivially copyable");
+public:
+    SeqLock(): seq(0){
+        for (auto& word: words){
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    void store(const T& value){
+        uint64_t buf[NWORDS] = {0};
+        memcpy(buf, &value, sizeof(T));
+        uint64_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);    // odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < NWORDS; i++){
+            words[i].store(buf[i], std::memory_order_relaxed);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    T load() const{
+        uint64_t buf[NWORDS];
+        for (;;){
+            uint64_t s1 = seq.load(std::memory_order_acquire);
+            if (s1 & 1){
+                continue;
+            }
+            for (size_t i = 0; i < NWORDS; i++){
+                buf[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s1){
+                break;
+            }
+        }
+        T value;
+        memcpy(&value, buf, sizeof(T));
+        return value;
+    }
+
+    // number of completed stores
+    uint64_t get_version() const{
+        return seq.load(std::memory_order_acquire) / 2;
+    }
+private:
+    static constexpr size_t NWORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> words[NWORDS];
+};
+
+#endif
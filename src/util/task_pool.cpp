@@ -0,0 +1,81 @@
+#include "task_pool.h"
+#include "event_loop.h"
+
+TaskPool::TaskPool(int nthreads): m_task(nullptr), m_ntasks(0), m_next(0), m_ndone(0), m_stopped(false){
+    for (int i = 0; i < nthreads; i++){
+        m_threads.emplace_back(&TaskPool::worker, this);
+    }
+}
+
+
+TaskPool::~TaskPool(){
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopped = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread: m_threads){
+        thread.join();
+    }
+}
+
+
+int TaskPool::get_threads_count() const{
+    return m_threads.size();
+}
+
+
+void TaskPool::run_tasks(std::unique_lock<std::mutex>& lock){
+    while (m_next < m_ntasks){
+        int idx = m_next++;
+        lock.unlock();
+        std::exception_ptr error;
+        try{
+            (*m_task)(idx);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error && !m_error){
+            m_error = error;
+        }
+        if (++m_ndone == m_ntasks){
+            m_done_cv.notify_one();
+        }
+    }
+}
+
+
+void TaskPool::worker(){
+    block_all_signals();    // signals are for measurement threads
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;){
+        m_work_cv.wait(lock, [this](){ return m_stopped || m_next < m_ntasks; });
+        if (m_stopped){
+            return;
+        }
+        run_tasks(lock);
+    }
+}
+
+
+void TaskPool::run(int ntasks, const std::function<void(int)>& task){
+    std::lock_guard<std::mutex> run_lock(m_run_lock);
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_task = &task;
+    m_ntasks = ntasks;
+    m_next = 0;
+    m_ndone = 0;
+    m_error = nullptr;
+    m_work_cv.notify_all();
+    run_tasks(lock);
+    m_done_cv.wait(lock, [this](){ return m_ndone == m_ntasks; });
+    m_ntasks = 0;   // workers go back to sleep
+    m_next = 0;
+    m_task = nullptr;
+    if (m_error){
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef __TaskPool__
+#define __TaskPool__
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fork-join pool: run() executes task(0..ntasks-1) and returns when all are done.
+ * Calling thread takes tasks too, so nthreads + 1 tasks run at once.
+ * Concurrent run() calls (pool shared by several users) are serialized.
+ */
+class TaskPool{
+public:
+    explicit TaskPool(int nthreads);
+    ~TaskPool();
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    void run(int ntasks, const std::function<void(int)>& task);    // rethrows first task exception
+    int get_threads_count() const;
+private:
+    std::mutex m_run_lock;      // one job at a time
+    std::mutex m_lock;          // guards fields below
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    const std::function<void(int)>* m_task;
+    int m_ntasks;
+    int m_next;                 // next task index to take
+    int m_ndone;
+    bool m_stopped;
+    std::exception_ptr m_error;
+    std::vector<std::thread> m_threads;
+
+    void worker();
+    void run_tasks(std::unique_lock<std::mutex>& lock);    // takes tasks until none left
+};
+
+#endif
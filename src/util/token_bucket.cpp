@@ -0,0 +1,55 @@
+#include "token_bucket.h"
+#include "clock.h"
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate, double depth):
+m_rate(rate), m_depth(depth), m_tokens(depth), m_last_refill(monotonic_us()) {};
+
+
+// called under lock
+void TokenBucket::refill(){
+    int64_t now = monotonic_us();
+    m_tokens = std::min(m_depth, m_tokens + (now - m_last_refill) * m_rate / 1000000.);
+    m_last_refill = now;
+}
+
+
+bool TokenBucket::try_consume(double bits){
+    std::lock_guard<std::mutex> lock(m_lock);
+    refill();
+    if (m_tokens < bits){
+        return false;
+    }
+    m_tokens -= bits;
+    return true;
+}
+
+
+void TokenBucket::consume(double bits){
+    std::lock_guard<std::mutex> lock(m_lock);
+    refill();
+    m_tokens -= bits;
+}
+
+
+int64_t TokenBucket::get_delay(double bits){
+    std::lock_guard<std::mutex> lock(m_lock);
+    refill();
+    bits = std::min(bits, m_depth);     // bigger cost would never fit
+    if (m_tokens >= bits || m_rate <= 0){
+        return 0;
+    }
+    return (int64_t)((bits - m_tokens) * 1000000. / m_rate) + 1;
+}
+
+
+double TokenBucket::get_level(){
+    std::lock_guard<std::mutex> lock(m_lock);
+    refill();
+    return m_depth > 0 ? m_tokens / m_depth : 0;
+}
+
+
+double TokenBucket::get_rate() const{
+    return m_rate;
+}
@@ -0,0 +1,29 @@
+#ifndef __TokenBucket__
+#define __TokenBucket__
+
+#include <mutex>
+#include <stdint.h>
+
+/* Token bucket of bits, thread-safe so several senders can share one budget.
+ * Bucket is allowed to go into debt when cost is known only afterwards
+ * (abw trains), later consumers wait until the debt is repaid.
+ */
+class TokenBucket{
+public:
+    TokenBucket(double rate, double depth);    // bits/sec, bits; starts full
+    bool try_consume(double bits);      // false and nothing taken if not enough tokens
+    void consume(double bits);          // always takes, may leave bucket in debt
+    int64_t get_delay(double bits);     // microseconds until bits are available
+    double get_level();                 // tokens / depth, negative when in debt
+    double get_rate() const;            // bits/sec
+private:
+    std::mutex m_lock;
+    double m_rate;
+    double m_depth;
+    double m_tokens;
+    int64_t m_last_refill;  // monotonic, microseconds
+
+    void refill();
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include "adaptive_gap.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+
+TEST(AdaptiveGap, RejectsNonPositiveMinimum){
+    EXPECT_THROW(AdaptiveGap(0, 1000), std::runtime_error);
+    EXPECT_THROW(AdaptiveGap(-1, 1000), std::runtime_error);
+}
+
+
+// 1 * 1.5 truncates back to 1, growth must not stall
+TEST(AdaptiveGap, SmallGapGrowsToMaximum){
+    AdaptiveGap gap(1, 100);
+    gap.update(1e6, 10000, 0);
+    int prev = gap.get_gap();
+    for (int i = 0; i < 20 && prev < 100; i++){
+        int next = gap.update(1e6, 10000, 0);
+        EXPECT_GT(next, prev);
+        prev = next;
+    }
+    EXPECT_EQ(prev, 100);
+    EXPECT_EQ(gap.update(1e6, 10000, 0), 100);
+}
+
+
+TEST(AdaptiveGap, ShiftDropsToMinimum){
+    AdaptiveGap gap(100000, 1000000);
+    gap.update(1e6, 10000, 0);
+    gap.update(1e6, 10000, 0);
+    EXPECT_GT(gap.get_gap(), 100000);
+    EXPECT_EQ(gap.update(0.5e6, 10000, 0), 100000);     // abw halved
+}
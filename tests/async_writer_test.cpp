@@ -0,0 +1,71 @@
+#include "util/async_writer.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <time.h>
+
+#define NRECORDS 1000
+
+
+static std::string make_record(int i){
+    return std::to_string(i) + '\n';
+}
+
+
+// flush interval is never reached, full queue must wake consumer
+TEST(AsyncWriter, FullQueueDoesNotWaitForFlushInterval){
+    std::ostringstream out;
+    std::string expected;
+    auto start = std::chrono::steady_clock::now();
+    {
+        AsyncWriter writer(out, 10000000, AsyncWriter::BLOCK, 4);
+        for (int i = 0; i < NRECORDS; i++){
+            expected += make_record(i);
+            EXPECT_TRUE(writer.write(make_record(i)));
+        }
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_EQ(out.str(), expected);
+}
+
+
+TEST(AsyncWriter, DropsNewestOnFullQueue){
+    std::ostringstream out;
+    uint64_t nwritten = 0;
+    uint64_t ndropped = 0;
+    {
+        AsyncWriter writer(out, 10000000, AsyncWriter::DROP_NEWEST, 4);
+        for (int i = 0; i < NRECORDS; i++){
+            nwritten += writer.write(make_record(i));
+        }
+        ndropped = writer.get_dropped();
+    }
+    EXPECT_EQ(nwritten + ndropped, (uint64_t)NRECORDS);
+
+    std::istringstream in(out.str());
+    int prev = -1;
+    int value;
+    uint64_t nread = 0;
+    while (in >> value){
+        EXPECT_GT(value, prev);     // in order, no duplicates
+        prev = value;
+        nread += 1;
+    }
+    EXPECT_EQ(nread, nwritten);
+}
+
+
+// zero flush interval is raised to minimum, idle consumer sleeps
+TEST(AsyncWriter, IdleWriterDoesNotSpin){
+    std::ostringstream out;
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    {
+        AsyncWriter writer(out, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+    int64_t cpu_time = (cpu_end.tv_sec - cpu_start.tv_sec) * 1000000000LL + (cpu_end.tv_nsec - cpu_start.tv_nsec);
+    EXPECT_LT(cpu_time, 50000000LL);
+}
@@ -0,0 +1,63 @@
+// Throughput of checksum kernels against RFC 1071 reference, by buffer size.
+
+#include "util/checksum.h"
+#include "checksum_reference.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+static std::vector<uint8_t> bench_buffer(size_t size){
+    std::vector<uint8_t> buf(size + 1);
+    for (size_t i = 0; i < buf.size(); i++){
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+    return buf;
+}
+
+
+static void BM_ChecksumReference(benchmark::State& state){
+    std::vector<uint8_t> buf = bench_buffer(state.range(0));
+    for (auto _ : state){
+        benchmark::DoNotOptimize(rfc1071_checksum(buf.data() + 1, state.range(0)));   // unaligned
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+
+template<uint64_t (*Kernel)(const uint8_t*, size_t)>
+static void BM_ChecksumKernel(benchmark::State& state){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if ((Kernel == checksum_partial_avx2 && !__builtin_cpu_supports("avx2")) ||
+        (Kernel == checksum_partial_sse2 && !__builtin_cpu_supports("sse2"))){
+        state.SkipWithError("not supported by CPU");
+        return;
+    }
+#endif
+    std::vector<uint8_t> buf = bench_buffer(state.range(0));
+    for (auto _ : state){
+        benchmark::DoNotOptimize(checksum_fold(Kernel(buf.data() + 1, state.range(0))));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+
+// what pinger calls, kernel chosen at runtime
+static void BM_ComputeChecksum(benchmark::State& state){
+    std::vector<uint8_t> buf = bench_buffer(state.range(0));
+    for (auto _ : state){
+        benchmark::DoNotOptimize(compute_checksum(buf.data() + 1, state.range(0)));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    state.SetLabel(checksum_kernel_name());
+}
+
+
+#define CHECKSUM_SIZES RangeMultiplier(4)->Range(16, 64 << 10)->Arg(1500)->Arg(9000)
+
+BENCHMARK(BM_ChecksumReference)->CHECKSUM_SIZES;
+BENCHMARK_TEMPLATE(BM_ChecksumKernel, checksum_partial_scalar)->CHECKSUM_SIZES;
+#if defined(__x86_64__) || defined(__i386__)
+BENCHMARK_TEMPLATE(BM_ChecksumKernel, checksum_partial_sse2)->CHECKSUM_SIZES;
+BENCHMARK_TEMPLATE(BM_ChecksumKernel, checksum_partial_avx2)->CHECKSUM_SIZES;
+#endif
+BENCHMARK(BM_ComputeChecksum)->CHECKSUM_SIZES;
@@ -0,0 +1,22 @@
+#ifndef __ChecksumReference__
+#define __ChecksumReference__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RFC 1071 as written: big-endian 16-bit words, odd byte padded with zero, folded carries
+static inline uint16_t rfc1071_checksum(const uint8_t* buf, size_t size){
+    uint32_t sum = 0;
+    size_t i = 0;
+    for (; i + 1 < size; i += 2){
+        sum += (buf[i] << 8) | buf[i + 1];
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    if (i < size){
+        sum += buf[i] << 8;
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "util/checksum.h"
+#include "checksum_reference.h"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <random>
+#include <string.h>
+#include <vector>
+
+// largest unaligned offset tried
+#define MAX_OFFSET 64
+
+typedef uint64_t (*Kernel)(const uint8_t*, size_t);
+
+struct KernelParam{
+    const char* name;
+    Kernel kernel;
+    const char* cpu_feature;    // nullptr - always available
+};
+
+static void PrintTo(const KernelParam& param, std::ostream* os){
+    *os << param.name;
+}
+
+static std::vector<KernelParam> kernels(){
+    std::vector<KernelParam> res = {{"scalar", checksum_partial_scalar, nullptr}};
+#if defined(__x86_64__) || defined(__i386__)
+    res.push_back({"sse2", checksum_partial_sse2, "sse2"});
+    res.push_back({"avx2", checksum_partial_avx2, "avx2"});
+#endif
+    return res;
+}
+
+static bool cpu_supports(const char* feature){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return feature == nullptr ||
+           (strcmp(feature, "sse2") == 0 && __builtin_cpu_supports("sse2")) ||
+           (strcmp(feature, "avx2") == 0 && __builtin_cpu_supports("avx2"));
+#else
+    return feature == nullptr;
+#endif
+}
+
+// kernel result as stored in packet (network order) vs reference in host order
+static uint16_t kernel_checksum(Kernel kernel, const uint8_t* buf, size_t size){
+    return ntohs((uint16_t)~checksum_fold(kernel(buf, size)));
+}
+
+
+class ChecksumKernel: public ::testing::TestWithParam<KernelParam>{
+protected:
+    void SetUp() override{
+        if (!cpu_supports(GetParam().cpu_feature)){
+            GTEST_SKIP() << GetParam().name << " is not supported by CPU";
+        }
+    }
+};
+
+
+TEST_P(ChecksumKernel, AllLengthsAndOffsetsOfRandomData){
+    std::mt19937 rng(1071);
+    std::vector<uint8_t> buf(MAX_OFFSET + 1024);
+    for (auto& byte: buf){
+        byte = rng();
+    }
+    for (size_t offset = 0; offset < MAX_OFFSET; offset++){
+        for (size_t size = 0; size <= 1024 - MAX_OFFSET; size++){
+            const uint8_t* data = buf.data() + offset;
+            ASSERT_EQ(kernel_checksum(GetParam().kernel, data, size), rfc1071_checksum(data, size))
+                << "size " << size << ", offset " << offset;
+        }
+    }
+}
+
+
+// carries of all-ones words at sizes beyond any packet
+TEST_P(ChecksumKernel, LargeBuffers){
+    std::mt19937 rng(1);
+    for (uint8_t fill: {0x00, 0xff}){
+        for (size_t size: {65535, 65536, 1 << 20}){
+            std::vector<uint8_t> buf(size + 1, fill);
+            for (size_t offset: {0, 1}){
+                ASSERT_EQ(kernel_checksum(GetParam().kernel, buf.data() + offset, size),
+                          rfc1071_checksum(buf.data() + offset, size)) << "size " << size;
+            }
+        }
+    }
+    std::vector<uint8_t> buf(1 << 20);
+    for (auto& byte: buf){
+        byte = rng();
+    }
+    EXPECT_EQ(kernel_checksum(GetParam().kernel, buf.data() + 3, buf.size() - 3),
+              rfc1071_checksum(buf.data() + 3, buf.size() - 3));
+}
+
+
+INSTANTIATE_TEST_SUITE_P(Kernels, ChecksumKernel, ::testing::ValuesIn(kernels()),
+                         [](const ::testing::TestParamInfo<KernelParam>& info){ return info.param.name; });
+
+
+// RFC 1071 section 3 example
+TEST(Checksum, RfcExample){
+    const uint8_t data[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    EXPECT_EQ(rfc1071_checksum(data, sizeof(data)), (uint16_t)~0xddf2);
+    EXPECT_EQ(ntohs(compute_checksum(data, sizeof(data))), (uint16_t)~0xddf2);
+}
+
+
+// checksum stored in header makes sum of whole packet verify to zero
+TEST(Checksum, StoredChecksumVerifies){
+    std::mt19937 rng(7);
+    for (size_t size: {8, 9, 64, 65, 1500, 1501}){
+        std::vector<uint8_t> packet(size);
+        for (auto& byte: packet){
+            byte = rng();
+        }
+        packet[2] = packet[3] = 0;
+        uint16_t checksum = compute_checksum(packet.data(), size);
+        memcpy(&packet[2], &checksum, sizeof(checksum));
+        EXPECT_EQ(compute_checksum(packet.data(), size), 0) << "size " << size;
+    }
+}
@@ -0,0 +1,59 @@
+#include "chest_record.h"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string.h>
+
+
+TEST(ChestRecord, RoundTrip){
+    ChestSnapshot snapshot = {};
+    snapshot.runnum = 7;
+    snapshot.time = 123456789;
+    snapshot.abw = 1.5e6;
+    snapshot.srtt = 10111;
+    snapshot.rtt_p99 = 15000;
+    snapshot.loss_total = 0.25;
+    snapshot.loss_local = -1;
+    snapshot.gap = 100000;
+    snapshot.budget_level = -3.5;
+    snapshot.pings_skipped = 9;
+
+    std::string stream;
+    encode_stream_header(stream);
+    encode_record(snapshot, "", stream);
+    encode_record(snapshot, "192.0.2.1", stream);
+    EXPECT_EQ(stream.size(), sizeof(ChestStreamHeader) + 2 * sizeof(ChestRecord) + 9);
+
+    std::istringstream in(stream);
+    decode_stream_header(in);
+    for (const char* expected_tag: {"", "192.0.2.1"}){
+        ChestSnapshot decoded;
+        std::string tag;
+        ASSERT_TRUE(decode_record(in, decoded, tag));
+        EXPECT_EQ(tag, expected_tag);
+        EXPECT_EQ(decoded.runnum, snapshot.runnum);
+        EXPECT_EQ(decoded.time, snapshot.time);
+        EXPECT_EQ(decoded.abw, snapshot.abw);
+        EXPECT_EQ(decoded.srtt, snapshot.srtt);
+        EXPECT_EQ(decoded.rtt_p99, snapshot.rtt_p99);
+        EXPECT_EQ(decoded.loss_total, snapshot.loss_total);
+        EXPECT_EQ(decoded.loss_local, snapshot.loss_local);
+        EXPECT_EQ(decoded.gap, snapshot.gap);
+        EXPECT_EQ(decoded.budget_level, snapshot.budget_level);
+        EXPECT_EQ(decoded.pings_skipped, snapshot.pings_skipped);
+    }
+    ChestSnapshot decoded;
+    std::string tag;
+    EXPECT_FALSE(decode_record(in, decoded, tag));
+}
+
+
+TEST(ChestRecord, RejectsOtherVersion){
+    std::string stream;
+    encode_stream_header(stream);
+    ChestStreamHeader header;
+    memcpy(&header, stream.data(), sizeof(header));
+    EXPECT_EQ(header.version, 1);
+    header.version = 2;
+    std::istringstream in(std::string((const char*)&header, sizeof(header)));
+    EXPECT_THROW(decode_stream_header(in), std::runtime_error);
+}
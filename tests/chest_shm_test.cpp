@@ -0,0 +1,47 @@
+#include "chest_shm.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+
+static std::string test_region_name(){
+    return "chest_shm_test." + std::to_string(getpid());
+}
+
+
+TEST(ChestShm, ReaderSeesPublishedSnapshot){
+    std::string name = test_region_name();
+    ChestShmWriter writer(name);
+    ChestShmReader reader(name);
+    EXPECT_EQ(reader.get_version(), 0u);
+    EXPECT_EQ(reader.get_writer_pid(), getpid());
+
+    ChestSnapshot snapshot = {};
+    snapshot.runnum = 3;
+    snapshot.srtt = 10111;
+    writer.publish(snapshot);
+    EXPECT_EQ(reader.get_version(), 1u);
+    EXPECT_EQ(reader.load().runnum, 3);
+    EXPECT_EQ(reader.load().srtt, 10111);
+    unlink((CHEST_SHM_DIR + name).c_str());
+}
+
+
+// restarted writer must not truncate region under mapped reader (SIGBUS)
+TEST(ChestShm, NewWriterKeepsOldRegionOfReader){
+    std::string name = test_region_name();
+    auto writer = std::make_unique<ChestShmWriter>(name);
+    ChestSnapshot snapshot = {};
+    snapshot.runnum = 5;
+    writer->publish(snapshot);
+    ChestShmReader old_reader(name);
+    writer.reset();
+
+    writer = std::make_unique<ChestShmWriter>(name);
+    EXPECT_EQ(old_reader.load().runnum, 5);
+    EXPECT_EQ(old_reader.get_version(), 1u);
+    ChestShmReader new_reader(name);
+    EXPECT_EQ(new_reader.get_version(), 0u);
+
+    EXPECT_NE(access((CHEST_SHM_DIR "." + name + "." + std::to_string(getpid())).c_str(), F_OK), 0);   // no temporary left
+    unlink((CHEST_SHM_DIR + name).c_str());
+}
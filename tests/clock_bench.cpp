@@ -0,0 +1,44 @@
+// Cost of one clock read: timer clock (vDSO clock_gettime), TSC path, realtime, gettimeofday.
+
+#include "util/clock.h"
+#include <benchmark/benchmark.h>
+#include <sys/time.h>
+
+
+static void BM_TimerClock(benchmark::State& state){
+    for (auto _ : state){
+        benchmark::DoNotOptimize(timer_clock_ns());
+    }
+}
+BENCHMARK(BM_TimerClock);
+
+
+static void BM_MonotonicTsc(benchmark::State& state){
+    if (!clock_use_tsc()){
+        state.SkipWithError("invariant TSC not available");
+        return;
+    }
+    for (auto _ : state){
+        benchmark::DoNotOptimize(monotonic_ns());
+    }
+    state.SetLabel(clock_source_name());
+}
+BENCHMARK(BM_MonotonicTsc);
+
+
+static void BM_Realtime(benchmark::State& state){
+    for (auto _ : state){
+        benchmark::DoNotOptimize(realtime_ns());
+    }
+}
+BENCHMARK(BM_Realtime);
+
+
+static void BM_Gettimeofday(benchmark::State& state){
+    struct timeval tv;
+    for (auto _ : state){
+        gettimeofday(&tv, NULL);
+        benchmark::DoNotOptimize(tv);
+    }
+}
+BENCHMARK(BM_Gettimeofday);
@@ -0,0 +1,43 @@
+#include "util/clock.h"
+#include "util/event_loop.h"
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <time.h>
+
+
+TEST(Clock, TimerClockIsClockMonotonic){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t before = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    int64_t now = timer_clock_ns();
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t after = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    EXPECT_LE(before, now);
+    EXPECT_LE(now, after);
+}
+
+
+// deadline taken from timer clock must not fire early, even with TSC on
+TEST(Clock, TimerFdFiresAtTimerClockDeadline){
+    clock_use_tsc();
+    TimerFd timer;
+    int64_t deadline = timer_clock_ns() + 5000000LL;
+    timer.arm_at(deadline);
+    struct pollfd pfd = { timer.get_fd(), POLLIN, 0 };
+    ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+    EXPECT_GE(timer_clock_ns(), deadline);
+}
+
+
+TEST(Clock, TscIntervalMatchesClockMonotonic){
+    if (!clock_use_tsc()){
+        GTEST_SKIP() << "invariant TSC not available";
+    }
+    int64_t tsc_start = monotonic_ns();
+    int64_t start = timer_clock_ns();
+    struct timespec pause = { 0, 20000000 };
+    nanosleep(&pause, NULL);
+    int64_t tsc_interval = monotonic_ns() - tsc_start;
+    int64_t interval = timer_clock_ns() - start;
+    EXPECT_NEAR((double)tsc_interval, (double)interval, interval * 0.01);
+}
@@ -0,0 +1,33 @@
+#ifndef __FakeABSender__
+#define __FakeABSender__
+
+#include "abet/abet.h"
+#include <chrono>
+#include <thread>
+
+
+// abw train which only takes time
+class FakeABSender: public ABSender{
+public:
+    explicit FakeABSender(int _train_time=0): train_time(_train_time) {};
+    virtual void run() override {};
+    virtual std::unique_ptr<ABSender> clone() const override { return std::make_unique<FakeABSender>(train_time); };
+    virtual bool validate() override { return true; };
+    virtual void setupRun() override {};
+    virtual void cleanup() override {};
+    virtual bool doOneMeasurementRound(std::list<MeasurementBundle>*) override {
+        std::this_thread::sleep_for(std::chrono::microseconds(train_time));
+        return true;
+    };
+    virtual bool processOneRoundRes(std::list<MeasurementBundle>* mb_list) override {
+        mb_list->clear();
+        return true;
+    };
+    virtual void resetRound() override {};
+    virtual float get_current_estimation() const override { return 1000000; };
+    virtual unsigned int get_last_round_overhead() const override { return 0; };
+private:
+    int train_time;     // microseconds
+};
+
+#endif
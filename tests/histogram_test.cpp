@@ -0,0 +1,119 @@
+#include "util/histogram.h"
+#include "ping/pinger.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+#define BIG_VALUE (1LL << 38)
+// bucket width over its lower bound, 2^-(sub_bucket_bits-1)
+#define RELATIVE_ERROR (1. / (1 << (DEFAULT_SUB_BUCKET_BITS - 1)))
+#define SLICE_NS (RTT_WINDOW_SEC * 1000000000LL / RTT_WINDOW_SLICES)
+
+
+// with one bigger sample, p50 is upper bound of bucket holding value
+static int64_t bucket_upper_bound(int64_t value){
+    LogLinearHistogram hist;
+    hist.record(value);
+    hist.record(BIG_VALUE);
+    return hist.get_percentile(50);
+}
+
+
+TEST(LogLinearHistogram, SmallValuesAreExact){
+    for (int64_t value = 0; value < (1 << DEFAULT_SUB_BUCKET_BITS); value++){
+        EXPECT_EQ(bucket_upper_bound(value), value);
+    }
+}
+
+
+// bucket bound covers value within relative error, next value after bound opens next bucket
+TEST(LogLinearHistogram, BucketBoundsWithinRelativeError){
+    for (int64_t value = 1 << DEFAULT_SUB_BUCKET_BITS; value < BIG_VALUE / 2; value = value * 5 / 4 + 1){
+        int64_t bound = bucket_upper_bound(value);
+        EXPECT_GE(bound, value);
+        EXPECT_LE(bound - value, value * RELATIVE_ERROR);
+        EXPECT_EQ(bucket_upper_bound(bound), bound);
+        EXPECT_GT(bucket_upper_bound(bound + 1), bound);
+    }
+}
+
+
+TEST(LogLinearHistogram, PercentilesAtEdgesOfRange){
+    LogLinearHistogram hist;
+    EXPECT_EQ(hist.get_percentile(50), 0);     // empty
+    hist.record(1000);
+    EXPECT_EQ(hist.get_percentile(0), 1000);
+    EXPECT_EQ(hist.get_percentile(100), 1000);  // clamped to observed range
+    hist.record(-5);                            // negative counts as 0
+    EXPECT_EQ(hist.get_min(), 0);
+    EXPECT_EQ(hist.get_percentile(0), 0);
+    EXPECT_EQ(hist.get_percentile(100), 1000);
+
+    LogLinearHistogram clamped(DEFAULT_SUB_BUCKET_BITS, 20);
+    clamped.record(1LL << 30);                  // beyond max_value_bits: last bucket
+    clamped.record(1LL << 31);
+    EXPECT_EQ(clamped.get_max(), 1LL << 31);
+    EXPECT_EQ(clamped.get_percentile(100), 1LL << 31);
+}
+
+
+TEST(LogLinearHistogram, QuantilesOfKnownSample){
+    std::mt19937 rng(5);
+    std::lognormal_distribution<double> rtt(16, 0.5);   // about 10 ms in nanoseconds
+    std::vector<int64_t> sample;
+    LogLinearHistogram hist;
+    for (int i = 0; i < 100000; i++){
+        sample.push_back((int64_t)rtt(rng));
+        hist.record(sample.back());
+    }
+    std::sort(sample.begin(), sample.end());
+    for (double percentile: {50., 90., 99.}){
+        int64_t exact = sample[(size_t)(percentile / 100. * sample.size() + 0.5) - 1];
+        int64_t estimate = hist.get_percentile(percentile);
+        EXPECT_GE(estimate, exact) << "p" << percentile;
+        EXPECT_LE(estimate - exact, exact * RELATIVE_ERROR) << "p" << percentile;
+    }
+    EXPECT_EQ(hist.get_max(), sample.back());
+    EXPECT_EQ(hist.get_percentile(100), sample.back());
+    EXPECT_EQ(hist.get_count(), sample.size());
+}
+
+
+TEST(LogLinearHistogram, MergeEqualsRecordingAll){
+    LogLinearHistogram first, second, all;
+    for (int64_t value = 1; value < 100000; value += 37){
+        (value % 2 ? first : second).record(value);
+        all.record(value);
+    }
+    first.merge(second);
+    EXPECT_EQ(first.get_count(), all.get_count());
+    EXPECT_EQ(first.get_min(), all.get_min());
+    EXPECT_EQ(first.get_max(), all.get_max());
+    for (double percentile: {1., 50., 90., 99., 100.}){
+        EXPECT_EQ(first.get_percentile(percentile), all.get_percentile(percentile));
+    }
+}
+
+
+// slices rotate on time of results, not on wall clock of test
+TEST(PingStatWindow, OldSamplesLeaveWindowOnly){
+    PingStat stats;
+    int64_t start = 1000 * SLICE_NS;
+    stats.process_ping_res(PingRes(50000), 0, false, start);
+    stats.process_ping_res(PingRes(1000), 1, false, start + SLICE_NS);
+    EXPECT_EQ(stats.get_max_rtt(), 50000);
+
+    // first slice is reused after one window
+    int64_t later = start + RTT_WINDOW_SLICES * SLICE_NS;
+    stats.process_ping_res(PingRes(2000), 2, false, later);
+    EXPECT_EQ(stats.get_rtt_histogram().get_count(), 2u);
+    EXPECT_EQ(stats.get_max_rtt(), 2000);
+    EXPECT_EQ(stats.get_max_rtt(true), 50000);
+    EXPECT_EQ(stats.get_rtt_histogram(true).get_count(), 3u);
+
+    // gap longer than window clears every slice
+    stats.process_ping_res(PingRes(3000), 3, false, later + 5 * RTT_WINDOW_SLICES * SLICE_NS);
+    EXPECT_EQ(stats.get_rtt_histogram().get_count(), 1u);
+    EXPECT_EQ(stats.get_rtt_percentile(50), 3000);
+    EXPECT_EQ(stats.get_rtt_percentile(100, true), 50000);
+}
@@ -0,0 +1,80 @@
+// LossElr against reference hash-map table: one abw round update and local loss query.
+
+#include "loss/loss.h"
+#include "loss_reference.h"
+#include <benchmark/benchmark.h>
+
+#define BENCH_BUNDLES 8
+
+
+// stream lengths 50-10000 packets, tau 5-100
+static void elr_args(benchmark::internal::Benchmark* bench){
+    bench->ArgsProduct({{50, 500, 2000, 10000}, {5, 20, 100}});
+}
+
+
+// args: stream length, tau
+static void BM_ElrRound(benchmark::State& state){
+    std::mt19937 rng(1);
+    std::vector<MeasurementBundle> round = random_round(rng, BENCH_BUNDLES, state.range(0));
+    MeasurementSpan span(round.data(), round.size());
+    LossElr elr(0, state.range(1));
+    for (auto _ : state){
+        elr.process_answer(span);
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_BUNDLES * state.range(0));
+}
+BENCHMARK(BM_ElrRound)->Apply(elr_args);
+
+
+static void BM_ElrRoundReference(benchmark::State& state){
+    std::mt19937 rng(1);
+    std::vector<MeasurementBundle> round = random_round(rng, BENCH_BUNDLES, state.range(0));
+    ReferenceElr ref(state.range(1));
+    for (auto _ : state){
+        ref.process_round(round);
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_BUNDLES * state.range(0));
+}
+BENCHMARK(BM_ElrRoundReference)->Apply(elr_args);
+
+
+static void BM_ElrLocalLoss(benchmark::State& state){
+    std::mt19937 rng(1);
+    std::vector<MeasurementBundle> round = random_round(rng, BENCH_BUNDLES, state.range(0));
+    LossElr elr(0, state.range(1));
+    elr.process_answer(MeasurementSpan(round.data(), round.size()));
+    for (auto _ : state){
+        benchmark::DoNotOptimize(elr.get_local_loss_percentage());
+    }
+}
+BENCHMARK(BM_ElrLocalLoss)->Apply(elr_args);
+
+
+static void BM_ElrLocalLossReference(benchmark::State& state){
+    std::mt19937 rng(1);
+    std::vector<MeasurementBundle> round = random_round(rng, BENCH_BUNDLES, state.range(0));
+    ReferenceElr ref(state.range(1));
+    ref.process_round(round);
+    for (auto _ : state){
+        benchmark::DoNotOptimize(ref.get_local_loss_percentage());
+    }
+}
+BENCHMARK(BM_ElrLocalLossReference)->Apply(elr_args);
+
+
+// args: threads counting one round of 64 streams, 1000 packets each
+static void BM_ElrRoundPooled(benchmark::State& state){
+    std::mt19937 rng(1);
+    std::vector<MeasurementBundle> round = random_round(rng, 64, 1000);
+    MeasurementSpan span(round.data(), round.size());
+    LossElr elr(0);
+    if (state.range(0) > 1){
+        elr.set_workers(std::make_shared<TaskPool>(state.range(0) - 1));
+    }
+    for (auto _ : state){
+        elr.process_answer(span);
+    }
+    state.SetItemsProcessed(state.iterations() * round.size() * 1000);
+}
+BENCHMARK(BM_ElrRoundPooled)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
@@ -0,0 +1,121 @@
+#ifndef __LossReference__
+#define __LossReference__
+
+#include "abet/abet.h"
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/* LossElr stats as first written: hash map keyed by delay in ms, window of every
+ * received packet scanned packet by packet, local loss summed over packets of last round.
+ * Same results as LossElr with default (1 ms) delay bucket.
+ */
+class ReferenceElr{
+public:
+    struct PktCount{
+        unsigned nlost = 0;
+        unsigned ntotal = 0;
+    };
+    explicit ReferenceElr(int _tau_nsteps): tau_nsteps(_tau_nsteps), nlost(0), nsamples(0) {};
+
+    void process_round(const std::vector<MeasurementBundle>& round){
+        delay_vec.clear();
+        for (const auto& mb: round){
+            nsamples += mb.m_remote_nsamples;
+            nlost += mb.m_remote_nlost;
+            count_stats(mb);
+        }
+    }
+
+    double get_total_loss_percentage() const{
+        return nsamples != 0 ? 100. * nlost / nsamples : 0;
+    }
+
+    // without consistency threshold
+    double get_local_loss_percentage() const{
+        double big_sum = 0;
+        for (int delay: delay_vec){
+            for (const auto& pkt_count: probabilities.at(delay)){
+                if (pkt_count.ntotal != 0 && pkt_count.nlost != 0){
+                    big_sum += (1. * pkt_count.nlost) / pkt_count.ntotal;
+                }
+            }
+        }
+        return 100 * big_sum / (delay_vec.size() * (tau_nsteps * 2 + 1));
+    }
+
+    std::unordered_map<int, std::vector<PktCount>> probabilities;
+private:
+    int tau_nsteps;
+    unsigned nlost;
+    unsigned nsamples;
+    std::vector<int> delay_vec;     // of last round
+
+    static int get_millisec(const timeval& tv){
+        if (tv.tv_sec == -1){
+            return -1;
+        }
+        int64_t res = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+        return (res < 0 || res > 1000000) ? -1 : (int)res;
+    }
+
+    void count_stats(const MeasurementBundle& mb){
+        const std::vector<timeval>& delays = mb.m_delays_vec;
+        int pkt_idx = 0;
+        int n_packets = delays.size();
+        for (const auto& tv: delays){
+            int delay = get_millisec(tv);
+            if (delay == -1){
+                continue;
+            }
+            delay_vec.push_back(delay);
+            std::vector<PktCount>& row = probabilities[delay];
+            row.resize(tau_nsteps * 2 + 1);
+            for (int i = -tau_nsteps; i <= tau_nsteps; i++){
+                int idx = pkt_idx + i;
+                if (idx < 0 || idx >= n_packets){
+                    continue;
+                }
+                if (delays[idx].tv_sec == -1){
+                    row[i + tau_nsteps].nlost += 1;
+                }
+                row[i + tau_nsteps].ntotal += 1;
+            }
+            pkt_idx += 1;
+        }
+    }
+};
+
+
+/* Synthetic abw round: streams of received delays 10-40 ms with jitter,
+ * losses in runs (two-state Gilbert model), about 5% of packets lost by default.
+ */
+static inline std::vector<MeasurementBundle> random_round(std::mt19937& rng, int nbundles, int length,
+                                                         double loss_start=0.025){
+    std::uniform_int_distribution<int> base_delay(10000, 30000);
+    std::uniform_int_distribution<int> jitter(0, 10000);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::vector<MeasurementBundle> round(nbundles);
+    for (auto& mb: round){
+        int base = base_delay(rng);
+        bool lossy = false;
+        for (int i = 0; i < length; i++){
+            lossy = lossy ? coin(rng) < 0.5 : coin(rng) < loss_start;
+            timeval tv;
+            if (lossy){
+                tv.tv_sec = -1;
+                tv.tv_usec = 0;
+            } else {
+                int delay = base + jitter(rng);
+                tv.tv_sec = delay / 1000000;
+                tv.tv_usec = delay % 1000000;
+            }
+            mb.m_delays_vec.push_back(tv);
+            mb.m_remote_nsamples += 1;
+            mb.m_remote_nlost += lossy;
+        }
+    }
+    return round;
+}
+
+#endif
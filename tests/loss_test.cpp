@@ -0,0 +1,176 @@
+#include "loss/loss.h"
+#include "loss_reference.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <yaml-cpp/yaml.h>
+
+// delays in microseconds, -1 - lost packet
+static MeasurementBundle make_bundle(const std::vector<int>& delays){
+    MeasurementBundle mb;
+    for (int delay: delays){
+        timeval tv;
+        tv.tv_sec = delay < 0 ? -1 : delay / 1000000;
+        tv.tv_usec = delay < 0 ? 0 : delay % 1000000;
+        mb.m_delays_vec.push_back(tv);
+        mb.m_remote_nsamples += 1;
+        mb.m_remote_nlost += delay < 0;
+    }
+    return mb;
+}
+
+static std::vector<PingRes> make_burst(const std::vector<int>& rtts){
+    std::vector<PingRes> burst;
+    for (int rtt: rtts){
+        burst.push_back(PingRes(rtt));
+    }
+    return burst;
+}
+
+
+TEST(LossElrBurst, BurstAloneGivesNoLocalLoss){
+    LossElr elr(0);
+    elr.process_answer(make_burst({1000, -1, 1000, -1, 1000}));
+    EXPECT_EQ(elr.get_local_loss_percentage(), -1);
+    EXPECT_DOUBLE_EQ(elr.get_total_loss_percentage(), 40);
+}
+
+
+// burst packets are not counted as packets of abw round
+TEST(LossElrBurst, BurstDoesNotJoinAbwRound){
+    std::vector<MeasurementBundle> round = {
+        make_bundle({2000, 2000, -1, 2100, 2300, -1, 2000, 2500}),
+        make_bundle({3000, -1, 3000, 3100, 3000, 3000, -1, -1}),
+    };
+    MeasurementSpan span(round.data(), round.size());
+    LossElr plain(0);
+    LossElr with_burst(0);
+    plain.process_answer(span);
+    with_burst.process_answer(span);
+    // rtt/2 in bucket no packet of round falls into
+    with_burst.process_answer(make_burst({80000, -1, 80000, 80000, -1, 80000}));
+    EXPECT_DOUBLE_EQ(plain.get_local_loss_percentage(), with_burst.get_local_loss_percentage());
+
+    // next abw round doesn't see burst packets either, only their stats
+    plain.process_answer(span);
+    with_burst.process_answer(span);
+    EXPECT_DOUBLE_EQ(plain.get_local_loss_percentage(), with_burst.get_local_loss_percentage());
+}
+
+
+// burst in bucket of round packets changes their loss probabilities only
+TEST(LossElrBurst, BurstUpdatesProbabilitiesOfRoundBuckets){
+    std::vector<MeasurementBundle> round = { make_bundle({2000, 2000, -1, 2000, 2000}) };
+    MeasurementSpan span(round.data(), round.size());
+    LossElr elr(0);
+    elr.process_answer(span);
+    double before = elr.get_local_loss_percentage();
+    elr.process_answer(make_burst({4000, 4000, 4000, 4000, 4000}));    // no losses near 2 ms
+    double after = elr.get_local_loss_percentage();
+    EXPECT_GT(before, 0);
+    EXPECT_LT(after, before);
+}
+
+
+// delay bucket -> {nlost, ntotal} per offset
+using ElrTable = std::map<int, std::vector<std::pair<unsigned, unsigned>>>;
+
+static ElrTable load_table(const LossElr& elr){
+    std::string filename = testing::TempDir() + "elr_table.yaml";
+    elr.serialize_to_file(filename);
+    ElrTable table;
+    for (const auto& elem: YAML::LoadFile(filename)["m_probabilities"]){
+        auto& row = table[elem.first.as<int>()];
+        for (const auto& count: elem.second){
+            row.emplace_back(count["nlost"].as<unsigned>(), count["ntotal"].as<unsigned>());
+        }
+    }
+    remove(filename.c_str());
+    return table;
+}
+
+static ElrTable reference_table(const ReferenceElr& ref){
+    ElrTable table;
+    for (const auto& elem: ref.probabilities){
+        auto& row = table[elem.first];
+        for (const auto& count: elem.second){
+            row.emplace_back(count.nlost, count.ntotal);
+        }
+    }
+    return table;
+}
+
+// table is integer and must match exactly, local loss is summed in other order
+static void expect_same_as_reference(const LossElr& elr, const ReferenceElr& ref){
+    EXPECT_EQ(load_table(elr), reference_table(ref));
+    EXPECT_DOUBLE_EQ(elr.get_total_loss_percentage(), ref.get_total_loss_percentage());
+    double local = ref.get_local_loss_percentage();
+    EXPECT_NEAR(elr.get_local_loss_percentage(), local, 1e-9 * local);
+}
+
+
+TEST(LossElrReference, DenseTableMatchesHashMap){
+    std::mt19937 rng(1);
+    LossElr elr(0);
+    ReferenceElr ref(TAU_NSTEPS);
+    for (int round = 0; round < 20; round++){
+        std::vector<MeasurementBundle> bundles = random_round(rng, 8, 50);
+        elr.process_answer(MeasurementSpan(bundles.data(), bundles.size()));
+        ref.process_round(bundles);
+        expect_same_as_reference(elr, ref);
+    }
+}
+
+
+// tau, stream length, loss start probability
+class LossElrWindow: public testing::TestWithParam<std::tuple<int, int, double>> {};
+
+// range ends of ntotal and lost bits of window, also across bitmap words and stream edges
+TEST_P(LossElrWindow, MatchesReference){
+    int tau = std::get<0>(GetParam());
+    int length = std::get<1>(GetParam());
+    double loss_start = std::get<2>(GetParam());
+    std::mt19937 rng(tau * 7919 + length);
+    LossElr elr(0, tau);
+    ReferenceElr ref(tau);
+    for (int round = 0; round < 4; round++){
+        std::vector<MeasurementBundle> bundles = random_round(rng, 4, length, loss_start);
+        elr.process_answer(MeasurementSpan(bundles.data(), bundles.size()));
+        ref.process_round(bundles);
+        expect_same_as_reference(elr, ref);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(TauAndLength, LossElrWindow, testing::Combine(
+    testing::Values(1, 5, 20, 100),
+    testing::Values(1, 7, 63, 64, 65, 130, 1000),
+    testing::Values(0.025, 0.4)));
+
+
+// shards are merged in stream order, so result can't depend on thread count
+TEST(LossElrPool, PooledRoundsAreBitIdenticalToSerial){
+    std::mt19937 rng(3);
+    std::vector<std::vector<MeasurementBundle>> rounds;
+    for (int round = 0; round < 5; round++){
+        rounds.push_back(random_round(rng, ELR_MIN_BUNDLES_PER_SHARD * 2 * 8 + round, 200));
+    }
+    LossElr serial(0);
+    ReferenceElr ref(TAU_NSTEPS);
+    std::vector<double> serial_local;
+    for (const auto& bundles: rounds){
+        serial.process_answer(MeasurementSpan(bundles.data(), bundles.size()));
+        ref.process_round(bundles);
+        serial_local.push_back(serial.get_local_loss_percentage());
+    }
+    expect_same_as_reference(serial, ref);
+
+    for (int nthreads: {2, 4, 8}){
+        LossElr pooled(0);
+        pooled.set_workers(std::make_shared<TaskPool>(nthreads - 1));
+        for (size_t i = 0; i < rounds.size(); i++){
+            pooled.process_answer(MeasurementSpan(rounds[i].data(), rounds[i].size()));
+            EXPECT_EQ(pooled.get_local_loss_percentage(), serial_local[i]) << nthreads << " threads";
+        }
+        EXPECT_EQ(load_table(pooled), load_table(serial)) << nthreads << " threads";
+        EXPECT_EQ(pooled.get_total_loss_percentage(), serial.get_total_loss_percentage());
+    }
+}
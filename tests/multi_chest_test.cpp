@@ -0,0 +1,45 @@
+#include "multi_chest.h"
+#include "fake_ab_sender.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <csignal>
+#include <pthread.h>
+#include <thread>
+
+
+// needs raw socket, loopback answers every probe; peers' pings come from shared pinger
+TEST(MultiChestSender, RoundsTakePingsOfSharedPinger){
+    std::unique_ptr<MultiChestSender> multi_sender;
+    try{
+        multi_sender = std::make_unique<MultiChestSender>(2, 1, 5000);
+    } catch (std::exception& e){
+        GTEST_SKIP() << e.what();
+    }
+    for (const char* host: {"127.0.0.1", "127.0.0.2"}){
+        std::unique_ptr<ABSender> ab_sender = std::make_unique<FakeABSender>(20000);
+        multi_sender->add_peer(std::make_unique<ChestSender>(ab_sender, LossDumb(), 30000), host);
+    }
+    multi_sender->set_output_file("/dev/null");
+
+    // SIGINT stays pending for signalfd of run() in every thread
+    sigset_t mask, prev_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &mask, &prev_mask);
+    std::thread thread([&multi_sender](){ multi_sender->run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto stop_time = std::chrono::steady_clock::now();
+    kill(getpid(), SIGINT);
+    thread.join();
+    pthread_sigmask(SIG_SETMASK, &prev_mask, NULL);
+    EXPECT_LT(std::chrono::steady_clock::now() - stop_time, std::chrono::milliseconds(100));
+
+    for (size_t i = 0; i < multi_sender->get_peers_count(); i++){
+        const ChestSender* peer = multi_sender->get_peer(i);
+        EXPECT_EQ(peer->get_pinger(), nullptr);
+        ChestSnapshot snapshot = peer->get_snapshot();
+        EXPECT_GE(snapshot.runnum, 2);
+        EXPECT_GT(snapshot.srtt, 0);
+        EXPECT_EQ(snapshot.loss_total, 0);
+    }
+}
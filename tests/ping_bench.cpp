@@ -0,0 +1,80 @@
+// CPU time spent per ping while waiting for the reply. Needs raw sockets (root).
+// Replies come from CHEST_BENCH_HOST (default 127.0.0.1), timeouts are measured against
+// CHEST_BENCH_SILENT_HOST (default 192.0.2.1, TEST-NET-1), it has to be routable but
+// never answer. Compare "CPU" with "Time" columns.
+
+#include "ping/pinger.h"
+#include "util/clock.h"
+#include <benchmark/benchmark.h>
+#include <stdexcept>
+
+#define BENCH_TIMEOUT 20000     // microseconds
+
+static const char* bench_host(const char* env, const char* fallback){
+    const char* host = getenv(env);
+    return host ? host : fallback;
+}
+
+
+/* Reply wait as it was before ppoll(): spin on non-blocking recvmsg until
+ * reply or timeout. Kept here as reference only.
+ */
+static bool spin_ping(IcmpSocket& sock, const struct sockaddr_storage& dst, socklen_t dst_len,
+                      int seq, int id, int timeout){
+    ProbeSendInfo sent = sock.send_echo(dst, dst_len, seq, id);
+    for (;;) {
+        EchoReply reply;
+        int error = sock.recv_echo_reply(reply);
+        if (error < 0) {
+            return false;
+        } else if (error > 0 && reply.id == id && reply.seq == (uint16_t)seq) {
+            return true;
+        }
+        if ((monotonic_ns() - sent.send_time) / 1000 >= timeout) {
+            return false;
+        }
+    }
+}
+
+
+static void BM_PingPoll(benchmark::State& state, const char* host){
+    try {
+        Pinger pinger(host, BENCH_TIMEOUT);
+        int seq = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(pinger.ping(seq++));
+        }
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+    }
+}
+
+
+static void BM_PingSpin(benchmark::State& state, const char* host){
+    try {
+        IcmpSocket sock;
+        struct addrinfo* addrinfo_list = nullptr;
+        resolve_addr(host, &addrinfo_list);
+        struct sockaddr_storage dst;
+        socklen_t dst_len = addrinfo_list->ai_addrlen;
+        memcpy(&dst, addrinfo_list->ai_addr, dst_len);
+        clear_addrinfo(addrinfo_list);
+
+        int seq = 0;
+        int id = (uint16_t)getpid();
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(spin_ping(sock, dst, dst_len, seq++, id, BENCH_TIMEOUT));
+        }
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+    }
+}
+
+
+static const char* reply_host = bench_host("CHEST_BENCH_HOST", "127.0.0.1");
+static const char* silent_host = bench_host("CHEST_BENCH_SILENT_HOST", "192.0.2.1");
+
+BENCHMARK_CAPTURE(BM_PingPoll, reply, reply_host)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_PingSpin, reply, reply_host)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_PingPoll, timeout, silent_host)->Unit(benchmark::kMillisecond)->Iterations(20);
+BENCHMARK_CAPTURE(BM_PingSpin, timeout, silent_host)->Unit(benchmark::kMillisecond)->Iterations(20);
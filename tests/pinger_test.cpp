@@ -0,0 +1,32 @@
+#include "ping/multi_pinger.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+// constructors open raw socket first
+static bool have_raw_socket(){
+    try{
+        IcmpSocket sock;
+        return true;
+    } catch (std::runtime_error&){
+        return false;
+    }
+}
+
+
+TEST(ContinuosPinger, RejectsNonPositiveGap){
+    if (!have_raw_socket()){
+        GTEST_SKIP() << "raw sockets need root";
+    }
+    EXPECT_THROW(ContinuosPinger("127.0.0.1", 0), std::runtime_error);
+    EXPECT_THROW(ContinuosPinger("127.0.0.1", -1000), std::runtime_error);
+    EXPECT_NO_THROW(ContinuosPinger("127.0.0.1", 1));
+}
+
+
+TEST(MultiPinger, RejectsNonPositiveGap){
+    if (!have_raw_socket()){
+        GTEST_SKIP() << "raw sockets need root";
+    }
+    EXPECT_THROW(MultiPinger(0), std::runtime_error);
+    EXPECT_NO_THROW(MultiPinger(1, 100000000));     // slot ring stays within 16-bit seq space
+}
@@ -0,0 +1,114 @@
+// Load test of ChestReceiver: many synthetic senders served by one receiver at once.
+
+#include "chest.h"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#define LOAD_SESSIONS 32
+#define LOAD_PACKETS 2000
+#define END_OF_TRAIN -1
+
+
+// counts sequence numbers of one synthetic sender on own loopback port
+class FakeABReceiver: public ABReceiver{
+public:
+    explicit FakeABReceiver(std::atomic<int>& _nready): nready(_nready), npackets(0), max_seq(-1) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        bind(fd, (struct sockaddr*)&addr, addr_len);
+        getsockname(fd, (struct sockaddr*)&addr, &addr_len);
+        port = ntohs(addr.sin_port);
+        struct timeval timeout = { 5, 0 };     // lost end of train fails test, doesn't hang it
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    };
+    ~FakeABReceiver(){
+        close(fd);
+    };
+    virtual void run() override {
+        nready += 1;
+        int seq;
+        while (recv(fd, &seq, sizeof(seq), 0) == sizeof(seq) && seq != END_OF_TRAIN){
+            npackets += 1;
+            max_seq = std::max(max_seq, seq);
+        }
+    };
+    virtual std::unique_ptr<ABReceiver> clone() const override { return std::make_unique<FakeABReceiver>(nready); };
+    virtual bool validate() override { return fd >= 0; };
+    virtual void cleanup() override {};
+
+    std::atomic<int>& nready;
+    int fd;
+    uint16_t port;
+    int npackets;
+    int max_seq;
+};
+
+
+// paced train of sequence numbers, then end marker
+static void synthetic_sender(uint16_t port){
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    for (int seq = 0; seq < LOAD_PACKETS; seq++){
+        send(fd, &seq, sizeof(seq), 0);
+        if (seq % 64 == 63){
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    int end = END_OF_TRAIN;
+    send(fd, &end, sizeof(end), 0);
+    close(fd);
+}
+
+
+TEST(ChestReceiverLoad, ServesManySendersConcurrently){
+    std::atomic<int> nready(0);
+    std::vector<FakeABReceiver*> sessions;
+    std::unique_ptr<ChestReceiver> receiver;
+    for (int i = 0; i < LOAD_SESSIONS; i++){
+        auto session = std::make_unique<FakeABReceiver>(nready);
+        sessions.push_back(session.get());
+        std::unique_ptr<ABReceiver> ab_receiver = std::move(session);
+        if (!receiver){
+            receiver = std::make_unique<ChestReceiver>(ab_receiver);
+        } else {
+            receiver->add_session(ab_receiver);
+        }
+    }
+    ASSERT_EQ(receiver->get_sessions_count(), (size_t)LOAD_SESSIONS);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread receiver_thread([&receiver](){ receiver->run(); });
+    // sessions served one after another never get ready all at once
+    while (nready < LOAD_SESSIONS && std::chrono::steady_clock::now() - start < std::chrono::seconds(2)){
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(nready, LOAD_SESSIONS);
+    std::vector<std::thread> senders;
+    for (auto session: sessions){
+        senders.emplace_back(synthetic_sender, session->port);
+    }
+    for (auto& sender: senders){
+        sender.join();
+    }
+    receiver_thread.join();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (auto session: sessions){
+        EXPECT_EQ(session->npackets, LOAD_PACKETS);
+        EXPECT_EQ(session->max_seq, LOAD_PACKETS - 1);
+    }
+    RecordProperty("elapsed_ms", (int)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
@@ -0,0 +1,75 @@
+// Cost of one round record: binary encoding against text and yaml output of ChestSender.
+
+#include "chest.h"
+#include "chest_record.h"
+#include "fake_ab_sender.h"
+#include <benchmark/benchmark.h>
+#include <sstream>
+
+
+static ChestSnapshot bench_snapshot(){
+    ChestSnapshot snapshot = {};
+    snapshot.runnum = 1234;
+    snapshot.time = 123456789;
+    snapshot.abw = 12345678.9;
+    snapshot.last_rtt = 10234;
+    snapshot.srtt = 10111;
+    snapshot.jitter = 321;
+    snapshot.rtt_p50 = 10050;
+    snapshot.rtt_p90 = 11000;
+    snapshot.rtt_p99 = 15000;
+    snapshot.rtt_max = 21000;
+    snapshot.loss_total = 0.25;
+    snapshot.loss_local = 0.5;
+    snapshot.overhead = 1200000;
+    snapshot.round_time = 250000;
+    snapshot.gap = 100000;
+    snapshot.budget_level = 100;
+    return snapshot;
+}
+
+
+static void BM_RecordEncode(benchmark::State& state){
+    ChestSnapshot snapshot = bench_snapshot();
+    std::string tag = "192.0.2.1";
+    std::string out;
+    for (auto _ : state){
+        out.clear();
+        encode_record(snapshot, tag, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_RecordEncode);
+
+
+static void BM_RecordDecode(benchmark::State& state){
+    std::string stream;
+    encode_record(bench_snapshot(), "192.0.2.1", stream);
+    ChestSnapshot snapshot;
+    std::string tag;
+    for (auto _ : state){
+        std::istringstream in(stream);
+        benchmark::DoNotOptimize(decode_record(in, snapshot, tag));
+    }
+}
+BENCHMARK(BM_RecordDecode);
+
+
+// 0 - text, 1 - yaml, 2 - binary through ChestSender::print_snapshot
+static void BM_RecordPrint(benchmark::State& state){
+    std::unique_ptr<ABSender> ab_sender = std::make_unique<FakeABSender>();
+    ChestSender sender(ab_sender, LossDumb());
+    sender.set_peer_tag("192.0.2.1");
+    sender.set_verbosity(0);
+    sender.set_output_format(state.range(0) == 1);
+    sender.set_binary_output(state.range(0) == 2);
+    ChestSnapshot snapshot = bench_snapshot();
+    std::ostringstream out;
+    for (auto _ : state){
+        out.str("");
+        sender.print_snapshot(snapshot, out);
+    }
+    state.SetLabel(state.range(0) == 0 ? "text" : state.range(0) == 1 ? "yaml" : "binary");
+}
+BENCHMARK(BM_RecordPrint)->DenseRange(0, 2);
@@ -0,0 +1,85 @@
+#include "util/seqlock.h"
+#include "chest_record.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+#define NSTORES 200000
+
+
+// every field is a function of i, so torn read is visible
+static ChestSnapshot make_snapshot(int i){
+    ChestSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.runnum = i;
+    snapshot.time = (int64_t)i * 1000;
+    snapshot.abw = i;
+    snapshot.last_rtt = i + 1;
+    snapshot.srtt = i + 2;
+    snapshot.jitter = i + 3;
+    snapshot.rtt_p50 = i + 4;
+    snapshot.rtt_p90 = i + 5;
+    snapshot.rtt_p99 = i + 6;
+    snapshot.rtt_max = i + 7;
+    snapshot.loss_total = i * 0.5;
+    snapshot.loss_local = -i * 0.25;
+    snapshot.overhead = i * 3;
+    snapshot.ping_dup = i + 8;
+    snapshot.ping_reord = i + 9;
+    snapshot.round_time = i + 10;
+    snapshot.gap = i + 11;
+    snapshot.budget_level = -i;
+    snapshot.pings_skipped = i + 12;
+    return snapshot;
+}
+
+
+static bool is_consistent(const ChestSnapshot& snapshot){
+    ChestSnapshot expected = make_snapshot(snapshot.runnum);
+    return memcmp(&snapshot, &expected, sizeof(snapshot)) == 0;
+}
+
+
+TEST(SeqLock, LoadSingleThread){
+    SeqLock<ChestSnapshot> lock;
+    EXPECT_EQ(lock.get_version(), 0u);
+    lock.store(make_snapshot(42));
+    EXPECT_EQ(lock.get_version(), 1u);
+    ChestSnapshot snapshot = lock.load();
+    EXPECT_EQ(snapshot.runnum, 42);
+    EXPECT_TRUE(is_consistent(snapshot));
+}
+
+
+TEST(SeqLock, ReaderNeverSeesTornSnapshot){
+    SeqLock<ChestSnapshot> lock;
+    lock.store(make_snapshot(0));
+    std::atomic<bool> done(false);
+    std::thread writer([&](){
+        for (int i = 1; i <= NSTORES; i++){
+            lock.store(make_snapshot(i));
+        }
+        done = true;
+    });
+
+    uint64_t last_version = 0;
+    int last_runnum = 0;
+    unsigned ntorn = 0;
+    unsigned nloads = 0;
+    while (!done || nloads == 0){
+        uint64_t version = lock.get_version();
+        ChestSnapshot snapshot = lock.load();
+        ntorn += !is_consistent(snapshot);
+        EXPECT_GE(version, last_version);
+        EXPECT_GE(snapshot.runnum, last_runnum);
+        // load happened after version was read
+        EXPECT_GE((uint64_t)snapshot.runnum + 1, version);
+        last_version = version;
+        last_runnum = snapshot.runnum;
+        nloads++;
+    }
+    writer.join();
+    EXPECT_EQ(ntorn, 0u);
+    EXPECT_EQ(lock.get_version(), (uint64_t)NSTORES + 1);
+    EXPECT_EQ(lock.load().runnum, NSTORES);
+}
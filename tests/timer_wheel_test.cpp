@@ -0,0 +1,96 @@
+#include "ping/multi_pinger.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+#define MS 1000000LL    // nanoseconds
+
+
+TEST(TimerWheel, EmptyWheelHasNoDeadline){
+    TimerWheel wheel(1000, 16);
+    wheel.reset(0);
+    EXPECT_EQ(wheel.next_deadline(), INT64_MAX);
+}
+
+
+TEST(TimerWheel, SleepsUntilNextOccupiedSlot){
+    TimerWheel wheel(1000, 16);
+    wheel.reset(0);
+    wheel.schedule(TimerWheel::Timer{7 * MS + 300, 0, -1});
+    EXPECT_EQ(wheel.next_deadline(), 7 * MS);
+
+    std::vector<TimerWheel::Timer> due;
+    wheel.advance(7 * MS, due);
+    EXPECT_TRUE(due.empty());
+    EXPECT_EQ(wheel.next_deadline(), 7 * MS + 300);   // timer is in current slot now
+    wheel.advance(7 * MS + 300, due);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(wheel.next_deadline(), INT64_MAX);
+}
+
+
+TEST(TimerWheel, KeepsTimersOfLaterRevolutions){
+    TimerWheel wheel(1000, 4);
+    wheel.reset(0);
+    wheel.schedule(TimerWheel::Timer{9 * MS, 1, 5});  // two revolutions ahead, slot 1
+    std::vector<TimerWheel::Timer> due;
+    wheel.advance(5 * MS, due);
+    EXPECT_TRUE(due.empty());
+    EXPECT_NE(wheel.next_deadline(), INT64_MAX);
+    wheel.advance(9 * MS, due);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0].target, 1);
+    EXPECT_EQ(due[0].seq, 5);
+}
+
+
+// occupancy bitmap spans two words, next slot is found across words and after wrap
+TEST(TimerWheel, FindsNextSlotAcrossBitmapWords){
+    TimerWheel wheel(1000, 100);
+    wheel.reset(0);
+    std::vector<TimerWheel::Timer> due;
+    wheel.advance(70 * MS, due);
+    wheel.schedule(TimerWheel::Timer{98 * MS, 0, -1});
+    wheel.schedule(TimerWheel::Timer{130 * MS, 0, 1});    // slot 30 of next revolution
+    EXPECT_EQ(wheel.next_deadline(), 98 * MS);
+    wheel.advance(98 * MS, due);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(wheel.next_deadline(), 130 * MS);
+    wheel.advance(130 * MS, due);
+    ASSERT_EQ(due.size(), 2u);
+    EXPECT_EQ(due[1].seq, 1);
+    EXPECT_EQ(wheel.next_deadline(), INT64_MAX);
+}
+
+
+// needs raw socket, loopback answers every probe
+TEST(MultiPinger, CollectsResultsUntilStopped){
+    std::unique_ptr<MultiPinger> pinger;
+    try{
+        pinger = std::make_unique<MultiPinger>(5000, 100000);
+    } catch (std::exception& e){
+        GTEST_SKIP() << e.what();
+    }
+    int first = pinger->add_target("127.0.0.1");
+    int second = pinger->add_target("127.0.0.2");
+    pinger->set_keep_results();
+    std::thread thread([&pinger](){ pinger->run_for(10000000); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    auto stop_time = std::chrono::steady_clock::now();
+    pinger->stop();
+    thread.join();
+    EXPECT_LT(std::chrono::steady_clock::now() - stop_time, std::chrono::milliseconds(50));
+
+    for (int target: {first, second}){
+        std::vector<MultiPinger::ProbeResult> results;
+        pinger->take_results(target, results);
+        ASSERT_GE(results.size(), 5u);
+        for (size_t i = 0; i < results.size(); i++){
+            EXPECT_GE(results[i].res.rtt, 0);
+            EXPECT_EQ(results[i].seq, (int)i);
+        }
+        results.clear();
+        pinger->take_results(target, results);
+        EXPECT_TRUE(results.empty());
+    }
+}
@@ -0,0 +1,46 @@
+#include "util/token_bucket.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+// bits/sec; refill during a test stays far below tolerances even on loaded machine
+#define SLOW_RATE 10.
+
+
+TEST(TokenBucket, TryConsumeRefusesWithoutTaking){
+    TokenBucket bucket(SLOW_RATE, 1000);
+    EXPECT_TRUE(bucket.try_consume(600));
+    EXPECT_FALSE(bucket.try_consume(600));
+    EXPECT_NEAR(bucket.get_level(), 0.4, 0.01);     // refused cost took nothing
+    EXPECT_TRUE(bucket.try_consume(390));
+}
+
+
+TEST(TokenBucket, ConsumeGoesIntoDebt){
+    TokenBucket bucket(SLOW_RATE, 1000);
+    bucket.consume(1500);
+    EXPECT_NEAR(bucket.get_level(), -0.5, 0.01);
+    EXPECT_FALSE(bucket.try_consume(1));
+}
+
+
+// cost over depth would never fit, so delay is for depth only
+TEST(TokenBucket, DelayCoversShortfallUpToDepth){
+    TokenBucket bucket(SLOW_RATE, 1000);
+    EXPECT_EQ(bucket.get_delay(500), 0);
+    bucket.consume(1500);   // -500 tokens
+    int64_t delay = bucket.get_delay(200);
+    EXPECT_NEAR(delay, 70000000, 1000000);      // microseconds for 700 bits
+    EXPECT_NEAR(bucket.get_delay(5000), 150000000, 1000000);
+    EXPECT_NEAR(bucket.get_delay(1000), bucket.get_delay(5000), 1000);
+}
+
+
+TEST(TokenBucket, RefillStopsAtDepth){
+    TokenBucket bucket(1000000, 1000);
+    bucket.consume(800);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));    // 20000 bits of refill
+    EXPECT_DOUBLE_EQ(bucket.get_level(), 1);
+    EXPECT_FALSE(bucket.try_consume(1001));
+    EXPECT_TRUE(bucket.try_consume(1000));
+}